@@ -28,5 +28,8 @@ void LArea::Create(String szName)
 	m_iFirstLight = 0;
 	m_iNumLights = 0;
 
+	m_iChunk_FirstRoom = 0;
+	m_iChunk_NumRooms = 0;
+
 	m_szName = szName;
 }
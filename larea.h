@@ -35,4 +35,8 @@ public:
 	// each area contains a list of global lights that affect this area
 	int m_iFirstLight;
 	int m_iNumLights;
+
+	// the rooms that are children of the area node, these can be unloaded and loaded again together
+	int m_iChunk_FirstRoom;
+	int m_iChunk_NumRooms;
 };
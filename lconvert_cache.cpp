@@ -0,0 +1,627 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lconvert_cache.h"
+#include "lroom_manager.h"
+#include "lroom_converter.h"
+#include "ldebug.h"
+#include "core/os/file_access.h"
+#include "core/math/geometry.h"
+#include "scene/3d/mesh_instance.h"
+#include "scene/3d/light.h"
+
+#define LCONVERT_CACHE_MAGIC 0x4350504C // "LPPC"
+
+
+LConvertCache::LConvertCache()
+{
+	m_uiHash = 0;
+	m_iNumPrevLights = 0;
+}
+
+void LConvertCache::HashScene(LRoomManager &manager, bool bDeleteLights, bool bSingleRoomMode)
+{
+	m_uiHash = hash_djb2_one_32(CACHE_VERSION);
+
+	// settings that change the conversion
+	Hash_Int(bDeleteLights);
+	Hash_Int(bSingleRoomMode);
+	Hash_Int(manager.m_bPortalPlane_Convention);
+	Hash_Int(manager.m_iPortalMaxVerts);
+	Hash_Int(manager.m_iBoundMaxPlanes);
+	Hash_Int(manager.m_bGraphOptimization);
+	Hash_Int(manager.m_iMergeMaxObjects);
+
+	// lights registered before conversion
+	m_iNumPrevLights = manager.m_Lights.size();
+	Hash_Int(m_iNumPrevLights);
+	for (int n=0; n<m_iNumPrevLights; n++)
+	{
+		const LLight &l = manager.m_Lights[n];
+		const LSource &s = l.m_Source;
+		Hash_Int(s.m_eType);
+		Hash_Int(s.m_RoomID);
+		Hash_Vector3(s.m_ptPos);
+		Hash_Vector3(s.m_ptDir);
+		Hash_Float(s.m_fRange);
+		Hash_String(l.m_szArea);
+	}
+
+	m_Nodes.clear();
+	m_NodeIDs.clear();
+	Hash_Recursive(manager.GetRoomList());
+}
+
+void LConvertCache::Hash_Vector3(const Vector3 &v)
+{
+	Hash_Float(v.x);
+	Hash_Float(v.y);
+	Hash_Float(v.z);
+}
+
+// Everything the converter reads from each node. The vertices of every mesh are hashed, as the automatic
+// room bounds are the hull of all of them, as well as the portal and bound meshes.
+// The order of the walk is also used to refer to nodes in the cache.
+void LConvertCache::Hash_Recursive(Node * pNode)
+{
+	m_NodeIDs.set(pNode->get_instance_id(), m_Nodes.size());
+	m_Nodes.push_back(pNode);
+
+	Hash_String(pNode->get_name());
+	Hash_String(pNode->get_class());
+
+	const Spatial * pSpat = Object::cast_to<Spatial>(pNode);
+	if (pSpat)
+	{
+		Hash_Int(pSpat->is_visible());
+
+		Transform tr = pSpat->get_global_transform();
+		for (int n=0; n<3; n++)
+			Hash_Vector3(tr.basis.get_axis(n));
+		Hash_Vector3(tr.origin);
+	}
+
+	const VisualInstance * pVI = Object::cast_to<VisualInstance>(pNode);
+	if (pVI)
+	{
+		AABB bb = pVI->get_aabb();
+		Hash_Vector3(bb.position);
+		Hash_Vector3(bb.size);
+	}
+
+	const GeometryInstance * pGI = Object::cast_to<GeometryInstance>(pNode);
+	if (pGI)
+		Hash_Int(pGI->get_cast_shadows_setting());
+
+	const MeshInstance * pMI = Object::cast_to<MeshInstance>(pNode);
+	if (pMI)
+		Hash_Mesh(*pMI);
+
+	const Light * pLight = Object::cast_to<Light>(pNode);
+	if (pLight)
+	{
+		Hash_Float(pLight->get_param(Light::PARAM_RANGE));
+		Hash_Float(pLight->get_param(Light::PARAM_SPOT_ANGLE));
+	}
+
+	for (int n=0; n<pNode->get_child_count(); n++)
+		Hash_Recursive(pNode->get_child(n));
+}
+
+void LConvertCache::Hash_Mesh(const MeshInstance &mi)
+{
+	Ref<Mesh> rmesh = mi.get_mesh();
+	if (rmesh.is_null())
+		return;
+
+	Array arrays = rmesh->surface_get_arrays(0);
+	if (!arrays.size())
+		return;
+
+	PoolVector<Vector3> p_vertices = arrays[VS::ARRAY_VERTEX];
+	Hash_Int(p_vertices.size());
+	for (int n=0; n<p_vertices.size(); n++)
+		Hash_Vector3(p_vertices[n]);
+}
+
+bool LConvertCache::Load(LRoomManager &manager, String szFilename)
+{
+	if (!FileAccess::exists(szFilename))
+		return false;
+
+	FileAccess * f = FileAccess::open(szFilename, FileAccess::READ);
+	if (!f)
+		return false;
+
+	// the header says whether the cache is up to date
+	bool bOK = (f->get_32() == LCONVERT_CACHE_MAGIC) && (f->get_32() == CACHE_VERSION) && (f->get_32() == sizeof(real_t));
+	bOK = bOK && (f->get_32() == m_uiHash) && ((int) f->get_32() == m_iNumPrevLights);
+
+	if (!bOK)
+	{
+		LPRINT(5, "conversion cache out of date : " + szFilename);
+		f->close();
+		memdelete(f);
+		return false;
+	}
+
+	f->get_buffer((uint8_t *) m_Sections, sizeof (m_Sections));
+	bOK = Load_Data(manager, *f);
+
+	f->close();
+	memdelete(f);
+
+	if (!bOK)
+	{
+		// leave the manager ready for a normal conversion
+		LWARN(5, "conversion cache does not match scene : " + szFilename);
+		manager.ReleaseResources(true);
+		return false;
+	}
+
+	LPRINT(5, "loaded conversion cache : " + szFilename);
+	return true;
+}
+
+template <class T> bool LConvertCache::Read_Section(FileAccess &f, eSection s, LVector<T> &items) const
+{
+	const LSection &sec = m_Sections[s];
+	items.resize(sec.m_uiCount);
+	if (!sec.m_uiCount)
+		return true;
+
+	f.seek(sec.m_uiOffset);
+	uint64_t size = (uint64_t) sec.m_uiCount * sizeof (T);
+	return f.get_buffer((uint8_t *) &items[0], size) == size;
+}
+
+template <class T> T * LConvertCache::GetNode(int node_id) const
+{
+	if ((node_id < 0) || (node_id >= m_Nodes.size()))
+		return 0;
+
+	return Object::cast_to<T>(m_Nodes[node_id]);
+}
+
+bool LConvertCache::CopyInts(const LRange &r, LVector<int> &ints) const
+{
+	if ((r.m_iFirst < 0) || (r.m_iNum < 0) || ((r.m_iFirst + r.m_iNum) > m_Ints.size()))
+		return false;
+
+	ints.resize(r.m_iNum);
+	for (int n=0; n<r.m_iNum; n++)
+		ints[n] = m_Ints[r.m_iFirst + n];
+
+	return true;
+}
+
+bool LConvertCache::Load_Data(LRoomManager &manager, FileAccess &f)
+{
+	LVector<LRoomRecord> rooms;
+	LVector<LPortalRecord> portals;
+	LVector<Vector3> verts;
+	LVector<Plane> planes;
+	LVector<LSobRecord> sobs;
+	LVector<LAreaRecord> areas;
+	LVector<LLightRecord> lights;
+	LVector<int32_t> deleted;
+	LVector<LUserRoomRecord> user_rooms;
+
+	bool bOK = Read_Section(f, S_ROOMS, rooms) && Read_Section(f, S_PORTALS, portals);
+	bOK = bOK && Read_Section(f, S_VERTS, verts) && Read_Section(f, S_PLANES, planes);
+	bOK = bOK && Read_Section(f, S_SOBS, sobs) && Read_Section(f, S_AREAS, areas);
+	bOK = bOK && Read_Section(f, S_LIGHTS, lights) && Read_Section(f, S_INTS, m_Ints);
+	bOK = bOK && Read_Section(f, S_DELETED, deleted) && Read_Section(f, S_USER_ROOMS, user_rooms);
+	if (!bOK)
+		return false;
+
+	manager.ReleaseResources(true);
+
+	bOK = Read_Section(f, S_AREA_ROOMS, manager.m_AreaRooms) && Read_Section(f, S_AREA_LIGHTS, manager.m_AreaLights);
+	bOK = bOK && Read_Section(f, S_SHADOW_CASTERS, manager.m_ShadowCasters_SOB) && Read_Section(f, S_LIGHT_CASTERS, manager.m_LightCasters_SOB);
+	if (!bOK)
+		return false;
+
+	// the only parsing needed is for the names
+	f.seek(m_Sections[S_NAMES].m_uiOffset);
+
+	// rooms
+	manager.m_Rooms.resize(rooms.size());
+	for (int r=0; r<rooms.size(); r++)
+	{
+		const LRoomRecord &rec = rooms[r];
+		LRoom &lroom = manager.m_Rooms[r];
+
+		Spatial * pGRoom = GetNode<Spatial>(rec.m_iNode);
+		if (!pGRoom)
+			return false;
+
+		lroom.m_GodotID = pGRoom->get_instance_id();
+		lroom.m_RoomID = r;
+		lroom.m_szName = f.get_pascal_string();
+
+		lroom.m_iFirstSOB = rec.m_iFirstSOB;
+		lroom.m_iNumSOBs = rec.m_iNumSOBs;
+		lroom.m_iFirstPortal = rec.m_iFirstPortal;
+		lroom.m_iNumPortals = rec.m_iNumPortals;
+		lroom.m_iFirstShadowCaster_SOB = rec.m_iFirstShadowCaster_SOB;
+		lroom.m_iNumShadowCasters_SOB = rec.m_iNumShadowCasters_SOB;
+		lroom.m_ptCentre = rec.m_ptCentre;
+		lroom.m_AABB = rec.m_AABB;
+
+		if (!CopyInts(rec.m_Areas, lroom.m_Areas) || !CopyInts(rec.m_LocalLights, lroom.m_LocalLights) || !CopyInts(rec.m_GlobalLights, lroom.m_GlobalLights))
+			return false;
+
+		const LRange &rp = rec.m_Planes;
+		if ((rp.m_iFirst < 0) || (rp.m_iNum < 0) || ((rp.m_iFirst + rp.m_iNum) > planes.size()))
+			return false;
+
+		lroom.m_Bound.m_Planes.resize(rp.m_iNum);
+		for (int n=0; n<rp.m_iNum; n++)
+			lroom.m_Bound.m_Planes[n] = planes[rp.m_iFirst + n];
+
+		// the bound mesh is only used for debugging, so is recreated rather than stored
+#ifdef DEBUG_ENABLED
+		if (rp.m_iNum)
+		{
+			PoolVector<Plane> bound_planes;
+			for (int n=0; n<rp.m_iNum; n++)
+				bound_planes.push_back(lroom.m_Bound.m_Planes[n]);
+			lroom.m_Bound_MeshData = Geometry::build_convex_mesh(bound_planes);
+		}
+#endif
+	}
+
+	// portals
+	manager.m_Portals.resize(portals.size());
+	for (int p=0; p<portals.size(); p++)
+	{
+		const LPortalRecord &rec = portals[p];
+		LPortal &port = manager.m_Portals[p];
+
+		port.m_szName = f.get_pascal_string();
+		port.m_iRoomNum = rec.m_iRoomNum;
+		port.m_bMirror = rec.m_iMirror != 0;
+		port.m_ptCentre = rec.m_ptCentre;
+		port.m_Plane = rec.m_Plane;
+
+		const LRange &rv = rec.m_Verts;
+		if ((rv.m_iFirst < 0) || (rv.m_iNum < 0) || ((rv.m_iFirst + rv.m_iNum) > verts.size()))
+			return false;
+
+		port.m_ptsWorld.resize(rv.m_iNum);
+		for (int n=0; n<rv.m_iNum; n++)
+			port.m_ptsWorld.set(n, verts[rv.m_iFirst + n]);
+	}
+
+	// areas
+	manager.m_Areas.resize(areas.size());
+	for (int n=0; n<areas.size(); n++)
+	{
+		const LAreaRecord &rec = areas[n];
+		LArea &area = manager.m_Areas[n];
+		area.Create(f.get_pascal_string());
+		area.m_iFirstRoom = rec.m_iFirstRoom;
+		area.m_iNumRooms = rec.m_iNumRooms;
+		area.m_iFirstLight = rec.m_iFirstLight;
+		area.m_iNumLights = rec.m_iNumLights;
+		area.m_iChunk_FirstRoom = rec.m_iChunk_FirstRoom;
+		area.m_iChunk_NumRooms = rec.m_iChunk_NumRooms;
+	}
+
+	// user rooms
+	manager.m_UserRooms.resize(user_rooms.size());
+	for (int n=0; n<user_rooms.size(); n++)
+	{
+		const LUserRoomRecord &rec = user_rooms[n];
+		LRoomManager::LUserRoom &user = manager.m_UserRooms[n];
+
+		Spatial * pGRoom = GetNode<Spatial>(rec.m_iNode);
+		if (!pGRoom || (rec.m_iRoom < 0) || (rec.m_iRoom >= rooms.size()))
+			return false;
+
+		user.m_iRoom = rec.m_iRoom;
+		user.m_GodotID = pGRoom->get_instance_id();
+		user.m_szName = f.get_pascal_string();
+	}
+	manager.UserRooms_Create();
+
+	// sobs
+	manager.m_SOBs.resize(sobs.size());
+	for (int n=0; n<sobs.size(); n++)
+	{
+		LSob &sob = manager.m_SOBs[n];
+
+		VisualInstance * pVI = GetNode<VisualInstance>(sobs[n].m_iNode);
+		if (!pVI)
+			return false;
+
+		sob.m_ID = pVI->get_instance_id();
+		sob.Hidable_Create(pVI);
+		sob.m_aabb = sobs[n].m_aabb;
+	}
+
+	// check the lights before making any changes to the scene
+	if (lights.size() < m_iNumPrevLights)
+		return false;
+
+	for (int n=0; n<lights.size(); n++)
+	{
+		const LLightRecord &rec = lights[n];
+		if ((n >= m_iNumPrevLights) && !GetNode<Light>(rec.m_iNode))
+			return false;
+
+		const LRange &ra = rec.m_AffectedRooms;
+		if ((ra.m_iNum > LLight::MAX_AFFECTED_ROOMS) || (ra.m_iFirst < 0) || ((ra.m_iFirst + ra.m_iNum) > m_Ints.size()))
+			return false;
+	}
+
+	for (int n=0; n<deleted.size(); n++)
+	{
+		if (!GetNode<Node>(deleted[n]))
+			return false;
+	}
+
+	// everything has been read, now make the same changes to the scene as the converter
+	for (int n=0; n<lights.size(); n++)
+	{
+		const LLightRecord &rec = lights[n];
+
+		if (n >= m_iNumPrevLights)
+		{
+			if (!manager.LightCreate(GetNode<Light>(rec.m_iNode), rec.m_iRoomID))
+				return false;
+		}
+
+		LLight &l = manager.m_Lights[n];
+		l.m_iArea = rec.m_iArea;
+		l.m_FirstCaster = rec.m_iFirstCaster;
+		l.m_NumCasters = rec.m_iNumCasters;
+
+		l.ClearAffectedRooms();
+		for (int i=0; i<rec.m_AffectedRooms.m_iNum; i++)
+			l.AddAffectedRoom(m_Ints[rec.m_AffectedRooms.m_iFirst + i]);
+	}
+
+	for (int n=0; n<manager.m_SOBs.size(); n++)
+		manager.m_SOBs[n].GetVI()->set_layer_mask(0);
+
+	for (int n=0; n<deleted.size(); n++)
+	{
+		Node * pNode = GetNode<Node>(deleted[n]);
+		Node * pParent = pNode->get_parent();
+		if (pParent)
+			pParent->remove_child(pNode);
+		pNode->queue_delete();
+	}
+
+	LRoomConverter conv;
+	conv.CreateRuntimeData(manager);
+
+	return true;
+}
+
+int LConvertCache::FindNode(ObjectID id) const
+{
+	const int * pID = m_NodeIDs.getptr(id);
+	if (!pID)
+		return -1;
+
+	return *pID;
+}
+
+template <class T> LConvertCache::LRange LConvertCache::AddInts(const LVector<T> &ints)
+{
+	LRange r;
+	r.m_iFirst = m_Ints.size();
+	r.m_iNum = ints.size();
+
+	for (int n=0; n<ints.size(); n++)
+		m_Ints.push_back(ints[n]);
+
+	return r;
+}
+
+template <class T> void LConvertCache::Write_Section(FileAccess &f, eSection s, const LVector<T> &items)
+{
+	LSection &sec = m_Sections[s];
+	sec.m_uiOffset = f.get_position();
+	sec.m_uiCount = items.size();
+
+	if (items.size())
+		f.store_buffer((const uint8_t *) &items[0], items.size() * sizeof (T));
+}
+
+bool LConvertCache::Save(const LRoomManager &manager, String szFilename, const LVector<ObjectID> &deleted_nodes)
+{
+	// build the records
+	m_Ints.clear();
+
+	LVector<LRoomRecord> rooms;
+	LVector<Plane> planes;
+	for (int r=0; r<manager.m_Rooms.size(); r++)
+	{
+		const LRoom &lroom = manager.m_Rooms[r];
+
+		LRoomRecord rec;
+		rec.m_iNode = FindNode(lroom.m_GodotID);
+		rec.m_iFirstSOB = lroom.m_iFirstSOB;
+		rec.m_iNumSOBs = lroom.m_iNumSOBs;
+		rec.m_iFirstPortal = lroom.m_iFirstPortal;
+		rec.m_iNumPortals = lroom.m_iNumPortals;
+		rec.m_iFirstShadowCaster_SOB = lroom.m_iFirstShadowCaster_SOB;
+		rec.m_iNumShadowCasters_SOB = lroom.m_iNumShadowCasters_SOB;
+		rec.m_ptCentre = lroom.m_ptCentre;
+		rec.m_AABB = lroom.m_AABB;
+		rec.m_Areas = AddInts(lroom.m_Areas);
+		rec.m_LocalLights = AddInts(lroom.m_LocalLights);
+		rec.m_GlobalLights = AddInts(lroom.m_GlobalLights);
+
+		rec.m_Planes.m_iFirst = planes.size();
+		rec.m_Planes.m_iNum = lroom.m_Bound.m_Planes.size();
+		for (int n=0; n<lroom.m_Bound.m_Planes.size(); n++)
+			planes.push_back(lroom.m_Bound.m_Planes[n]);
+
+		rooms.push_back(rec);
+	}
+
+	LVector<LPortalRecord> portals;
+	LVector<Vector3> verts;
+	for (int p=0; p<manager.m_Portals.size(); p++)
+	{
+		const LPortal &port = manager.m_Portals[p];
+
+		LPortalRecord rec;
+		rec.m_iRoomNum = port.m_iRoomNum;
+		rec.m_iMirror = port.m_bMirror;
+		rec.m_ptCentre = port.m_ptCentre;
+		rec.m_Plane = port.m_Plane;
+
+		rec.m_Verts.m_iFirst = verts.size();
+		rec.m_Verts.m_iNum = port.m_ptsWorld.size();
+		for (int n=0; n<port.m_ptsWorld.size(); n++)
+			verts.push_back(port.m_ptsWorld[n]);
+
+		portals.push_back(rec);
+	}
+
+	LVector<LSobRecord> sobs;
+	for (int n=0; n<manager.m_SOBs.size(); n++)
+	{
+		LSobRecord rec;
+		rec.m_iNode = FindNode(manager.m_SOBs[n].m_ID);
+		rec.m_aabb = manager.m_SOBs[n].m_aabb;
+		sobs.push_back(rec);
+	}
+
+	LVector<LAreaRecord> areas;
+	for (int n=0; n<manager.m_Areas.size(); n++)
+	{
+		const LArea &area = manager.m_Areas[n];
+
+		LAreaRecord rec;
+		rec.m_iFirstRoom = area.m_iFirstRoom;
+		rec.m_iNumRooms = area.m_iNumRooms;
+		rec.m_iFirstLight = area.m_iFirstLight;
+		rec.m_iNumLights = area.m_iNumLights;
+		rec.m_iChunk_FirstRoom = area.m_iChunk_FirstRoom;
+		rec.m_iChunk_NumRooms = area.m_iChunk_NumRooms;
+		areas.push_back(rec);
+	}
+
+	LVector<LLightRecord> lights;
+	for (int n=0; n<manager.m_Lights.size(); n++)
+	{
+		const LLight &l = manager.m_Lights[n];
+
+		LLightRecord rec;
+		rec.m_iNode = (n >= m_iNumPrevLights) ? FindNode(l.m_GodotID) : -1;
+		rec.m_iRoomID = l.m_Source.m_RoomID;
+		rec.m_iArea = l.m_iArea;
+		rec.m_iFirstCaster = l.m_FirstCaster;
+		rec.m_iNumCasters = l.m_NumCasters;
+
+		rec.m_AffectedRooms.m_iFirst = m_Ints.size();
+		rec.m_AffectedRooms.m_iNum = l.m_NumAffectedRooms;
+		for (int i=0; i<l.m_NumAffectedRooms; i++)
+			m_Ints.push_back(l.m_AffectedRooms[i]);
+
+		lights.push_back(rec);
+	}
+
+	LVector<int32_t> deleted;
+	for (int n=0; n<deleted_nodes.size(); n++)
+		deleted.push_back(FindNode(deleted_nodes[n]));
+
+	LVector<LUserRoomRecord> user_rooms;
+	for (int n=0; n<manager.m_UserRooms.size(); n++)
+	{
+		LUserRoomRecord rec;
+		rec.m_iNode = FindNode(manager.m_UserRooms[n].m_GodotID);
+		rec.m_iRoom = manager.m_UserRooms[n].m_iRoom;
+		user_rooms.push_back(rec);
+	}
+
+	// write
+	FileAccess * f = FileAccess::open(szFilename, FileAccess::WRITE);
+	if (!f)
+	{
+		LWARN(5, "could not write conversion cache : " + szFilename);
+		return false;
+	}
+
+	f->store_32(LCONVERT_CACHE_MAGIC);
+	f->store_32(CACHE_VERSION);
+	f->store_32(sizeof(real_t));
+	f->store_32(m_uiHash);
+	f->store_32(m_iNumPrevLights);
+
+	// the section table is filled in at the end
+	uint64_t table_pos = f->get_position();
+	memset(m_Sections, 0, sizeof (m_Sections));
+	f->store_buffer((const uint8_t *) m_Sections, sizeof (m_Sections));
+
+	Write_Section(*f, S_ROOMS, rooms);
+	Write_Section(*f, S_PORTALS, portals);
+	Write_Section(*f, S_VERTS, verts);
+	Write_Section(*f, S_PLANES, planes);
+	Write_Section(*f, S_SOBS, sobs);
+	Write_Section(*f, S_AREAS, areas);
+	Write_Section(*f, S_LIGHTS, lights);
+	Write_Section(*f, S_INTS, m_Ints);
+	Write_Section(*f, S_AREA_ROOMS, manager.m_AreaRooms);
+	Write_Section(*f, S_AREA_LIGHTS, manager.m_AreaLights);
+	Write_Section(*f, S_SHADOW_CASTERS, manager.m_ShadowCasters_SOB);
+	Write_Section(*f, S_LIGHT_CASTERS, manager.m_LightCasters_SOB);
+	Write_Section(*f, S_DELETED, deleted);
+	Write_Section(*f, S_USER_ROOMS, user_rooms);
+
+	m_Sections[S_NAMES].m_uiOffset = f->get_position();
+	m_Sections[S_NAMES].m_uiCount = manager.m_Rooms.size() + manager.m_Portals.size() + manager.m_Areas.size() + manager.m_UserRooms.size();
+	for (int n=0; n<manager.m_Rooms.size(); n++)
+		f->store_pascal_string(manager.m_Rooms[n].m_szName);
+	for (int n=0; n<manager.m_Portals.size(); n++)
+		f->store_pascal_string(manager.m_Portals[n].m_szName);
+	for (int n=0; n<manager.m_Areas.size(); n++)
+		f->store_pascal_string(manager.m_Areas[n].m_szName);
+	for (int n=0; n<manager.m_UserRooms.size(); n++)
+		f->store_pascal_string(manager.m_UserRooms[n].m_szName);
+
+	f->seek(table_pos);
+	f->store_buffer((const uint8_t *) m_Sections, sizeof (m_Sections));
+
+	bool bOK = f->get_error() == OK;
+
+	f->close();
+	memdelete(f);
+
+	if (!bOK)
+	{
+		LWARN(5, "error writing conversion cache : " + szFilename);
+		return false;
+	}
+
+	LPRINT(5, "saved conversion cache : " + szFilename);
+	return true;
+}
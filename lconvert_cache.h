@@ -0,0 +1,185 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/aabb.h"
+#include "core/math/plane.h"
+#include "core/hashfuncs.h"
+#include "core/hash_map.h"
+
+class LRoomManager;
+class FileAccess;
+class Node;
+class MeshInstance;
+
+// Converting a large level (qhull bounds, portal geometry, light traces, shadow casters) can take seconds.
+// The converted data can be written to a cache file, along with a hash of the source scene.
+// On the next rooms_convert, if the hash matches, the data is loaded instead of recomputed,
+// and only the changes the converter makes to the scene (deleting portal meshes etc) are replayed.
+
+// The file is flat and pointer free. A section table gives the offset of each array of fixed size records,
+// which are read in one go straight into memory. Variable length lists are ranges in a shared int pool,
+// and godot nodes are referred to by their index in the order the scene was walked when hashing,
+// so no node paths need to be looked up when loading.
+class LConvertCache
+{
+public:
+	enum {CACHE_VERSION = 4};
+
+	LConvertCache();
+
+	// must be called before converting, as conversion changes the scene
+	void HashScene(LRoomManager &manager, bool bDeleteLights, bool bSingleRoomMode);
+
+	// returns false if the file is missing, out of date or doesn't match the scene
+	bool Load(LRoomManager &manager, String szFilename);
+	bool Save(const LRoomManager &manager, String szFilename, const LVector<ObjectID> &deleted_nodes);
+
+private:
+	enum eSection
+	{
+		S_ROOMS,
+		S_PORTALS,
+		S_VERTS,
+		S_PLANES,
+		S_SOBS,
+		S_AREAS,
+		S_LIGHTS,
+		S_INTS, // pool for the lists within records
+		S_AREA_ROOMS,
+		S_AREA_LIGHTS,
+		S_SHADOW_CASTERS,
+		S_LIGHT_CASTERS,
+		S_DELETED,
+		S_USER_ROOMS,
+		S_NAMES, // pascal strings, rooms then portals then areas then user rooms
+		NUM_SECTIONS,
+	};
+
+	struct LSection
+	{
+		uint32_t m_uiOffset;
+		uint32_t m_uiCount;
+	};
+
+	// a range in one of the pools
+	struct LRange
+	{
+		int32_t m_iFirst;
+		int32_t m_iNum;
+	};
+
+	// records are only made of 32 bit values, so have no padding
+	struct LRoomRecord
+	{
+		int32_t m_iNode;
+		int32_t m_iFirstSOB;
+		int32_t m_iNumSOBs;
+		int32_t m_iFirstPortal;
+		int32_t m_iNumPortals;
+		int32_t m_iFirstShadowCaster_SOB;
+		int32_t m_iNumShadowCasters_SOB;
+		Vector3 m_ptCentre;
+		AABB m_AABB;
+		LRange m_Areas;
+		LRange m_LocalLights;
+		LRange m_GlobalLights;
+		LRange m_Planes;
+	};
+
+	struct LPortalRecord
+	{
+		int32_t m_iRoomNum;
+		int32_t m_iMirror;
+		Vector3 m_ptCentre;
+		Plane m_Plane;
+		LRange m_Verts;
+	};
+
+	struct LSobRecord
+	{
+		int32_t m_iNode;
+		AABB m_aabb;
+	};
+
+	struct LAreaRecord
+	{
+		int32_t m_iFirstRoom;
+		int32_t m_iNumRooms;
+		int32_t m_iFirstLight;
+		int32_t m_iNumLights;
+		int32_t m_iChunk_FirstRoom;
+		int32_t m_iChunk_NumRooms;
+	};
+
+	// only when rooms were merged
+	struct LUserRoomRecord
+	{
+		int32_t m_iNode;
+		int32_t m_iRoom;
+	};
+
+	struct LLightRecord
+	{
+		int32_t m_iNode; // -1 for lights registered before conversion
+		int32_t m_iRoomID;
+		int32_t m_iArea;
+		int32_t m_iFirstCaster;
+		int32_t m_iNumCasters;
+		LRange m_AffectedRooms;
+	};
+
+	// hashing
+	void Hash_Recursive(Node * pNode);
+	void Hash_Mesh(const MeshInstance &mi);
+	void Hash_Int(uint32_t v) {m_uiHash = hash_djb2_one_32(v, m_uiHash);}
+	void Hash_Float(float f) {m_uiHash = hash_djb2_one_float(f, m_uiHash);}
+	void Hash_String(const String &sz) {Hash_Int(sz.hash());}
+	void Hash_Vector3(const Vector3 &v);
+
+	// loading
+	bool Load_Data(LRoomManager &manager, FileAccess &f);
+	template <class T> bool Read_Section(FileAccess &f, eSection s, LVector<T> &items) const;
+	template <class T> T * GetNode(int node_id) const;
+	bool CopyInts(const LRange &r, LVector<int> &ints) const;
+
+	// saving
+	template <class T> void Write_Section(FileAccess &f, eSection s, const LVector<T> &items);
+	template <class T> LRange AddInts(const LVector<T> &ints);
+	int FindNode(ObjectID id) const;
+
+	uint32_t m_uiHash;
+
+	// lights registered before conversion (global lights), the converter adds the room lights after these
+	int m_iNumPrevLights;
+
+	// the scene in the order it was hashed
+	LVector<Node *> m_Nodes;
+	HashMap<ObjectID, int> m_NodeIDs;
+
+	LSection m_Sections[NUM_SECTIONS];
+	LVector<int32_t> m_Ints;
+};
@@ -0,0 +1,118 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "ldedup.h"
+
+
+LPointDedup::LPointDedup(float fTolerance)
+{
+	m_fTolerance = fTolerance;
+
+	// twice the tolerance, so rounding at the cell edges can't hide a match
+	m_fInvCellSize = 0.5f / fTolerance;
+}
+
+uint64_t LPointDedup::MakeKey(int64_t x, int64_t y, int64_t z)
+{
+	// wraps for huge coords, which only costs some extra distance tests
+	const uint64_t mask = ((uint64_t) 1 << 21) - 1;
+	return ((x & mask) << 42) | ((y & mask) << 21) | (z & mask);
+}
+
+bool LPointDedup::AddIfUnique(const Vector3 &pt)
+{
+	int64_t cx = Cell(pt.x);
+	int64_t cy = Cell(pt.y);
+	int64_t cz = Cell(pt.z);
+
+	// anything within the tolerance must be in a neighbouring cell
+	for (int64_t z=cz-1; z<=cz+1; z++)
+	{
+		for (int64_t y=cy-1; y<=cy+1; y++)
+		{
+			for (int64_t x=cx-1; x<=cx+1; x++)
+			{
+				const int * pHead = m_Heads.getptr(MakeKey(x, y, z));
+				if (!pHead)
+					continue;
+
+				for (int i=*pHead; i!=-1; i=m_Next[i])
+				{
+					Vector3 ptDiff = pt - m_Points[i];
+					if (ptDiff.length() < m_fTolerance)
+						return false;
+				}
+			}
+		}
+	}
+
+	uint64_t key = MakeKey(cx, cy, cz);
+	const int * pHead = m_Heads.getptr(key);
+
+	m_Next.push_back(pHead ? *pHead : -1);
+	m_Heads.set(key, m_Points.size());
+	m_Points.push_back(pt);
+	return true;
+}
+
+
+LPlaneDedup::LPlaneDedup(float fDistTolerance, float fMinDot)
+{
+	m_fDistTolerance = fDistTolerance;
+	m_fMinDot = fMinDot;
+	m_fInvCellSize = 0.5f / fDistTolerance;
+}
+
+bool LPlaneDedup::AddIfUnique(const Plane &p)
+{
+	int64_t cd = Cell(p.d);
+
+	for (int64_t d=cd-1; d<=cd+1; d++)
+	{
+		const int * pHead = m_Heads.getptr((uint64_t) d);
+		if (!pHead)
+			continue;
+
+		for (int i=*pHead; i!=-1; i=m_Next[i])
+		{
+			const Plane &o = m_Planes[i];
+
+			if (fabs(p.d - o.d) > m_fDistTolerance) continue;
+
+			float dot = p.normal.dot(o.normal);
+			if (dot < m_fMinDot) continue;
+
+			// match!
+			return false;
+		}
+	}
+
+	uint64_t key = (uint64_t) cd;
+	const int * pHead = m_Heads.getptr(key);
+
+	m_Next.push_back(pHead ? *pHead : -1);
+	m_Heads.set(key, m_Planes.size());
+	m_Planes.push_back(p);
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/hash_map.h"
+#include "core/math/plane.h"
+
+// Removing near duplicates by comparing against everything already kept is n squared,
+// which gets slow with large meshes. These hash the kept items into cells bigger than the
+// tolerance, so only neighbouring cells need checking. The results are the same as the brute force test.
+class LPointDedup
+{
+public:
+	LPointDedup(float fTolerance);
+
+	// returns false if the point is within the tolerance of a point already added
+	bool AddIfUnique(const Vector3 &pt);
+
+private:
+	int64_t Cell(float f) const {return (int64_t) Math::floor(f * m_fInvCellSize);}
+	static uint64_t MakeKey(int64_t x, int64_t y, int64_t z);
+
+	float m_fTolerance;
+	float m_fInvCellSize;
+
+	LVector<Vector3> m_Points;
+
+	// last point in each cell, and the previous point in the same cell
+	HashMap<uint64_t, int> m_Heads;
+	LVector<int> m_Next;
+};
+
+// planes are matched if the distances are close and the normals are nearly parallel,
+// so they are hashed by distance alone
+class LPlaneDedup
+{
+public:
+	LPlaneDedup(float fDistTolerance, float fMinDot);
+
+	// returns false if the plane matches a plane already added
+	bool AddIfUnique(const Plane &p);
+
+private:
+	int64_t Cell(float d) const {return (int64_t) Math::floor(d * m_fInvCellSize);}
+
+	float m_fDistTolerance;
+	float m_fMinDot;
+	float m_fInvCellSize;
+
+	LVector<Plane> m_Planes;
+	HashMap<uint64_t, int> m_Heads;
+	LVector<int> m_Next;
+};
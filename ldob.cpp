@@ -23,6 +23,7 @@
 */
 
 #include "ldob.h"
+#include "lroom.h"
 #include "scene/3d/mesh_instance.h"
 #include "scene/3d/light.h"
 
@@ -47,6 +48,10 @@ void LHidable::Show(bool bShow)
 	// new state
 	m_bShow = bShow;
 
+	// released when the area was unloaded
+	if (!m_pNode)
+		return;
+
 	assert (m_pParent);
 
 	if (m_bDetach)
@@ -129,6 +134,11 @@ void LLight::Light_SetDefaults()
 
 	m_NumAffectedRooms = 0;
 	m_iArea = -1;
+
+	m_bTraced = false;
+	m_iTracedRoomID = -1;
+	m_fTracedRange = 0.0f;
+	m_fTracedSlack = 0.0f;
 }
 
 bool LLight::AddAffectedRoom(int room_id)
@@ -268,3 +278,34 @@ VisualInstance * LDob::GetVI() const
 	return pVI;
 }
 
+void LDob::Show(bool bShow)
+{
+	// noop
+	if (bShow == m_bVisible)
+		return;
+
+	m_bVisible = bShow;
+
+	VisualInstance * pVI = GetVI();
+	if (!pVI)
+		return;
+
+	if (bShow)
+		pVI->show();
+	else
+		pVI->hide();
+}
+
+// dobs casting shadows into the view from out of view are shown on the light layer only
+void LDob::SetLayerMask(uint32_t mask)
+{
+	if (mask == m_uiLayerMask)
+		return;
+
+	m_uiLayerMask = mask;
+
+	VisualInstance * pVI = GetVI();
+	if (pVI)
+		LRoom::SoftShow(pVI, mask);
+}
+
@@ -35,6 +35,7 @@ class LHidable
 {
 public:
 	void Hidable_Create(Node * pNode);
+	void Hidable_Release() {m_pNode = 0; m_pParent = 0;}
 	void Show(bool bShow);
 
 	// new .. can be separated from the scene tree to cull
@@ -69,11 +70,30 @@ public:
 	Spatial * GetSpatial() const;
 	VisualInstance * GetVI() const;
 
+	// only touches godot if the state changes
+	void Show(bool bShow);
+	void SetLayerMask(uint32_t mask);
+
 	bool m_bSlotTaken;
-	bool m_bVisible;
+	bool m_bVisible; // shown state of the visual instance
+	bool m_bAutoUpdate; // position polled from the spatial each frame
+	uint32_t m_uiLayerMask; // room system layers last applied to the visual instance
 	float m_fRadius;
 	int m_iRoomID;
 
+	// position at the last update, for culling
+	Vector3 m_ptPos;
+
+	// intrusive list of the dobs in the same room (slots, -1 for none)
+	int m_iPrevInRoom;
+	int m_iNextInRoom;
+
+	// when the slot is free, the next free slot
+	int m_iNextFree;
+
+	// incremented each time the slot is freed, so stale handles can be detected
+	unsigned int m_uiGeneration;
+
 	ObjectID m_ID_Spatial;
 	ObjectID m_ID_VI;
 };
@@ -157,6 +177,13 @@ public:
 	uint16_t m_AffectedRooms[MAX_AFFECTED_ROOMS];
 	int m_NumAffectedRooms;
 
+	// source when the affected rooms were last traced, moves that can't change the rooms are not retraced
+	bool m_bTraced;
+	int m_iTracedRoomID;
+	Vector3 m_ptTracedPos;
+	float m_fTracedRange;
+	float m_fTracedSlack; // how far the light can move without a retrace, 0 or less to always retrace
+
 	// for global lights, this is the area or -1 if unset
 	int m_iArea;
 	String m_szArea; // set to the area string in the case of area lights, else ""
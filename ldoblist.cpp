@@ -3,7 +3,7 @@
 #include "ldebug.h"
 
 // returns whether changed room
-bool LDobList::FindDOBOldAndNewRoom(LRoomManager &manager, int dob_id, const Vector3 &pos, int &old_room_id, int &new_room_id)
+bool LDobList::FindDOBOldAndNewRoom(LRoomManager &manager, int dob_id, const Vector3 &prev_pos, const Vector3 &pos, int &old_room_id, int &new_room_id)
 {
 	LDob &dob = GetDob(dob_id);
 
@@ -20,105 +20,226 @@ bool LDobList::FindDOBOldAndNewRoom(LRoomManager &manager, int dob_id, const Vec
 	old_room_id = dob.m_iRoomID;
 	new_room_id = old_room_id; // default
 
-	bool bChangedRoom = false;
-	LRoom * pCurrentRoom = 0;
-
 	if (old_room_id == -1)
-		bChangedRoom = true;
-	else
 	{
-		pCurrentRoom = manager.GetRoom(old_room_id);
-
-		// deal with the case that the DOB has moved way outside the room
-		if (!pCurrentRoom->m_Bound.IsPointWithin(pos, 1.0f))
-			bChangedRoom = true;
+		new_room_id = manager.FindClosestRoom(pos);
+		return new_room_id != old_room_id;
 	}
 
-	// if changed room definitely?
-	if (bChangedRoom)
+	const LRoom * pCurrentRoom = manager.GetRoom(old_room_id);
+	if (!pCurrentRoom)
 	{
-		// revert to expensive method (may have been teleported etc)
 		new_room_id = manager.FindClosestRoom(pos);
+		return new_room_id != old_room_id;
+	}
 
-		if (new_room_id != old_room_id)
-			return true;
-		else
+	// the usual case, still within the room and behind every portal
+	if (pCurrentRoom->m_Bound.IsPointWithin(pos, 1.0f))
+	{
+		bool bAhead = false;
+		for (int p=0; p<pCurrentRoom->m_iNumPortals; p++)
+		{
+			const LPortal &port = manager.m_Portals[pCurrentRoom->m_iFirstPortal + p];
+			if (port.m_Plane.distance_to(pos) > slop)
+			{
+				bAhead = true;
+				break;
+			}
+		}
+
+		if (!bAhead)
 			return false;
 	}
 
+	// follow the movement through the portals, fast objects can pass through several rooms in a frame
+	new_room_id = WalkPortals(manager, old_room_id, prev_pos, pos, slop);
+
+	// revert to expensive method (may have been teleported, passed through a wall etc)
+	if (new_room_id == -1)
+		new_room_id = manager.FindClosestRoom(pos);
 
-	assert (pCurrentRoom);
+	return new_room_id != old_room_id;
+}
 
-	// check each portal - has the object crossed it into the neighbouring room?
-	for (int p=0; p<pCurrentRoom->m_iNumPortals; p++)
+// Walks the portal graph along the segment from the previous position, crossing the first portal
+// the segment passes through in each room. Returns the room at the end of the segment, or -1
+// if the segment leaves a room other than through a portal.
+int LDobList::WalkPortals(LRoomManager &manager, int room_id, const Vector3 &ptFrom, const Vector3 &ptTo, float slop) const
+{
+	// allowance for the segment passing just outside the edge of a portal
+	const float margin = 0.1f;
+
+	Vector3 ptStart = ptFrom;
+
+	for (int hop=0; hop<MAX_PORTAL_HOPS; hop++)
 	{
-		const LPortal &port = manager.m_Portals[pCurrentRoom->m_iFirstPortal + p];
+		const LRoom &lroom = manager.m_Rooms[room_id];
 
-		float dist = port.m_Plane.distance_to(pos);
+		int best_portal = -1;
+		float best_t = FLT_MAX;
+		Vector3 ptBestHit;
+		bool bAhead = false;
 
-		if (dist > slop)
+		for (int p=0; p<lroom.m_iNumPortals; p++)
 		{
-			LPRINT(0, "DOB at pos " + pos + " ahead of portal " + port.get_name() + " by " + String(Variant(dist)));
+			const LPortal &port = manager.m_Portals[lroom.m_iFirstPortal + p];
+
+			// hasn't left through this portal
+			float dist_to = port.m_Plane.distance_to(ptTo);
+			if (dist_to <= slop)
+				continue;
+
+			bAhead = true;
+
+			// portals into unloaded areas are closed, so the DOB can't have left through them
+			if (!manager.m_Rooms[port.m_iRoomNum].m_bLoaded)
+				continue;
+
+			// the start may already be ahead of the portal, within the slop
+			float dist_from = port.m_Plane.distance_to(ptStart);
+			float t = 0.0f;
+			if (dist_from < 0.0f)
+				t = dist_from / (dist_from - dist_to);
+
+			if (t >= best_t)
+				continue;
 
-			new_room_id = manager.Portal_GetLinkedRoom(port).m_RoomID;
-			return true;
+			Vector3 ptHit = ptStart + ((ptTo - ptStart) * t);
+			if (!port.IsPointWithin(ptHit, margin))
+				continue;
+
+			best_portal = p;
+			best_t = t;
+			ptBestHit = ptHit;
 		}
+
+		if (best_portal == -1)
+		{
+			// ended in this room
+			if (!bAhead && lroom.m_Bound.IsPointWithin(ptTo, 1.0f))
+				return room_id;
+
+			return -1;
+		}
+
+		const LPortal &port = manager.m_Portals[lroom.m_iFirstPortal + best_portal];
+		LPRINT(0, "DOB crossing portal " + port.get_name() + " at " + ptBestHit);
+
+		room_id = manager.Portal_GetLinkedRoom(port).m_RoomID;
+		ptStart = ptBestHit;
 	}
 
-	return false;
+	// gone through too many rooms to be worth following
+	return -1;
 }
 
-void LDobList::UpdateVisibility(LRoomManager &manager, Spatial * pDOBSpatial, int dob_id)
+void LDobList::ChangeRoom(LRoomManager &manager, int dob_id, int new_room_id)
 {
 	LDob &dob = GetDob(dob_id);
 
-	// get the room
-	LRoom * pRoom = manager.GetRoom(dob.m_iRoomID);
-	bool bRoomVisible = pRoom->IsVisible();
-
-	Spatial * pDOB = pDOBSpatial;
-
-	bool bDobVis = pDOB->is_visible_in_tree();
-	if (bDobVis != bRoomVisible)
+	// unlink from the old room
+	if (dob.m_iRoomID != -1)
 	{
-		//String sz = "DOB " + pDOB->get_name() + "\t";
-
-		if (bRoomVisible)
-		{
-			pDOB->show();
-			//sz += "coming into view";
-		}
+		if (dob.m_iPrevInRoom != -1)
+			GetDob(dob.m_iPrevInRoom).m_iNextInRoom = dob.m_iNextInRoom;
 		else
 		{
-			pDOB->hide();
-			//sz += "exiting view";
+			LRoom * pOldRoom = manager.GetRoom(dob.m_iRoomID);
+			if (pOldRoom)
+				pOldRoom->m_iFirstDOB = dob.m_iNextInRoom;
 		}
 
-		//print_line(sz);
+		if (dob.m_iNextInRoom != -1)
+			GetDob(dob.m_iNextInRoom).m_iPrevInRoom = dob.m_iPrevInRoom;
 	}
 
+	dob.m_iPrevInRoom = -1;
+	dob.m_iNextInRoom = -1;
+	dob.m_iRoomID = -1;
+
+	if (new_room_id == -1)
+		return;
+
+	// link at the head of the new room
+	LRoom * pNewRoom = manager.GetRoom(new_room_id);
+	if (!pNewRoom)
+		return;
+
+	dob.m_iNextInRoom = pNewRoom->m_iFirstDOB;
+	if (dob.m_iNextInRoom != -1)
+		GetDob(dob.m_iNextInRoom).m_iPrevInRoom = dob_id;
 
+	pNewRoom->m_iFirstDOB = dob_id;
+	dob.m_iRoomID = new_room_id;
 }
 
+void LDobList::SetAutoUpdate(int dob_id, bool bAuto)
+{
+	LDob &dob = GetDob(dob_id);
+	if (dob.m_bAutoUpdate == bAuto)
+		return;
 
+	dob.m_bAutoUpdate = bAuto;
+
+	if (bAuto)
+	{
+		m_AutoList.push_back(dob_id);
+		return;
+	}
 
+	for (int n=0; n<m_AutoList.size(); n++)
+	{
+		if (m_AutoList[n] == dob_id)
+		{
+			m_AutoList.remove_unsorted(n);
+			return;
+		}
+	}
+}
+
+// Rather than a script call per dob, the global transforms are read natively.
+// Godot only recalculates a global transform when it is dirty, and dobs that haven't moved
+// are skipped before the room test, so static dobs cost little more than the lookup.
+int LDobList::AutoUpdate(LRoomManager &manager)
+{
+	int nMoved = 0;
+
+	for (int n=0; n<m_AutoList.size(); n++)
+	{
+		int dob_id = m_AutoList[n];
+		LDob &dob = GetDob(dob_id);
+
+		// the spatial may have been deleted without unregistering
+		Spatial * pSpatial = dob.GetSpatial();
+		if (!pSpatial || !pSpatial->is_inside_tree())
+			continue;
+
+		Vector3 pos = pSpatial->get_global_transform().origin;
+		if (pos == dob.m_ptPos)
+			continue;
+
+		UpdateDob(manager, dob_id, pos);
+		nMoved++;
+	}
+
+	return nMoved;
+}
+
+// visibility is no longer changed here, dobs are culled in the camera trace and shown / hidden
+// once per frame (see LRoomManager::FrameUpdate_FinalizeVisibility_DOBs)
 int LDobList::UpdateDob(LRoomManager &manager, int dob_id, const Vector3 &pos)
 {
 	LDob &dob = GetDob(dob_id);
-
-	// get the VI for showing / hiding
-	Spatial * pSpat = (Spatial *) dob.GetVI();
+	Vector3 prev_pos = dob.m_ptPos;
+	dob.m_ptPos = pos;
 
 	int old_room, new_room;
 
-	if (FindDOBOldAndNewRoom(manager, dob_id, pos, old_room, new_room))
+	if (FindDOBOldAndNewRoom(manager, dob_id, prev_pos, pos, old_room, new_room))
 	{
-		dob.m_iRoomID = new_room;
+		ChangeRoom(manager, dob_id, new_room);
 	}
 
-	if (dob_id != manager.m_DOB_id_camera)
-		UpdateVisibility(manager, pSpat, dob_id);
-
 	return dob.m_iRoomID;
 }
 
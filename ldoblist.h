@@ -5,54 +5,133 @@
 
 class LRoomManager;
 
+// Dobs are referred to from script by a handle, which packs the slot in the list
+// and a generation count for the slot, so that stale handles of unregistered dobs are rejected
+// rather than referring to whichever dob reuses the slot.
 class LDobList
 {
 public:
+	enum
+	{
+		HANDLE_SLOT_BITS = 20,
+		HANDLE_SLOT_MASK = (1 << HANDLE_SLOT_BITS) - 1,
+		HANDLE_GENERATION_MASK = (1 << (31 - HANDLE_SLOT_BITS)) - 1,
+
+		// longest portal walk before falling back to a closest room search
+		MAX_PORTAL_HOPS = 16,
+	};
+
+	LDobList() {m_iFirstFree = -1;}
+
 	// getting
 	LDob &GetDob(int n) {return m_List[n];}
 	const LDob &GetDob(int n) const {return m_List[n];}
 
+	int GetNumDobs() const {return m_List.size();}
+
+	// handles
+	int GetHandle(int slot) const;
+	int FindSlot(int handle) const; // -1 if the handle is invalid
+
 	// request delete
 	int Request();
-	void DeleteDob(int id);
+	void DeleteDob(LRoomManager &manager, int id);
 
 	// funcs
 	int UpdateDob(LRoomManager &manager, int dob_id, const Vector3 &pos);
-	void UpdateVisibility(LRoomManager &manager, Spatial * pDOBSpatial, int dob_id);
+
+	// move the dob between the room membership lists
+	void ChangeRoom(LRoomManager &manager, int dob_id, int new_room_id);
+
+	// auto update dobs are polled each frame rather than updated from script
+	void SetAutoUpdate(int dob_id, bool bAuto);
+	int AutoUpdate(LRoomManager &manager); // returns the number that moved
+	int GetNumAutoUpdate() const {return m_AutoList.size();}
 
 private:
-	bool FindDOBOldAndNewRoom(LRoomManager &manager, int dob_id, const Vector3 &pos, int &old_room_id, int &new_room_id);
+	bool FindDOBOldAndNewRoom(LRoomManager &manager, int dob_id, const Vector3 &prev_pos, const Vector3 &pos, int &old_room_id, int &new_room_id);
+	int WalkPortals(LRoomManager &manager, int room_id, const Vector3 &ptFrom, const Vector3 &ptTo, float slop) const;
 
 	LVector<LDob> m_List;
+
+	// intrusive list of free slots through LDob::m_iNextFree
+	int m_iFirstFree;
+
+	// slots of the auto update dobs
+	LVector<int> m_AutoList;
 };
 
 
 /////////////////////////////////////////////////////////
 
-inline void LDobList::DeleteDob(int id)
+inline int LDobList::GetHandle(int slot) const
 {
-	GetDob(id).m_bSlotTaken = false;
+	unsigned int generation = m_List[slot].m_uiGeneration & HANDLE_GENERATION_MASK;
+	return (int) ((generation << HANDLE_SLOT_BITS) | slot);
+}
+
+inline int LDobList::FindSlot(int handle) const
+{
+	if (handle < 0)
+		return -1;
+
+	int slot = handle & HANDLE_SLOT_MASK;
+	if (slot >= m_List.size())
+		return -1;
+
+	const LDob &d = m_List[slot];
+	if (!d.m_bSlotTaken)
+		return -1;
+
+	unsigned int generation = (unsigned int) handle >> HANDLE_SLOT_BITS;
+	if (generation != (d.m_uiGeneration & HANDLE_GENERATION_MASK))
+		return -1;
+
+	return slot;
+}
+
+inline void LDobList::DeleteDob(LRoomManager &manager, int id)
+{
+	SetAutoUpdate(id, false);
+	ChangeRoom(manager, id, -1);
+
+	LDob &d = GetDob(id);
+	d.m_bSlotTaken = false;
+	d.m_uiGeneration++;
+
+	d.m_iNextFree = m_iFirstFree;
+	m_iFirstFree = id;
 }
 
 
 inline int LDobList::Request()
 {
-	for (int n=0; n<m_List.size(); n++)
+	int slot = m_iFirstFree;
+
+	if (slot != -1)
 	{
-		LDob &d = m_List[n];
-		if (d.m_bSlotTaken == false)
-		{
-			d.m_bSlotTaken = true;
-			return n;
-		}
+		m_iFirstFree = m_List[slot].m_iNextFree;
 	}
+	else
+	{
+		// none free, create new
+		ERR_FAIL_COND_V(m_List.size() > HANDLE_SLOT_MASK, -1);
 
-	// none found, create new
-	LDob * p = m_List.request();
-	memset(p, 0, sizeof (LDob));
+		// value initialized, the fields are all zero
+		LDob * p = m_List.request();
+		*p = LDob();
+		slot = m_List.size()-1;
+	}
 
-	p->m_bSlotTaken = true;
-	p->m_iRoomID = -1;
+	LDob &d = m_List[slot];
+	d.m_bSlotTaken = true;
+	d.m_bVisible = true;
+	d.m_iRoomID = -1;
+	d.m_iPrevInRoom = -1;
+	d.m_iNextInRoom = -1;
+	d.m_iNextFree = -1;
+	d.m_bAutoUpdate = false;
+	d.m_uiLayerMask = 0;
 
-	return m_List.size()-1;
+	return slot;
 }
@@ -0,0 +1,265 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "llight_budget.h"
+#include "lroom_manager.h"
+
+
+// bonus for lights within the budget last frame
+#define LLIGHT_BUDGET_HYSTERESIS 1.25f
+
+LLightBudget::LLightBudget()
+{
+	m_iMaxActive = 0;
+	m_iMaxShadowed = 0;
+	m_iNumCandidates = 0;
+	m_iNumCulled = 0;
+	m_iNumShadowsOff = 0;
+}
+
+void LLightBudget::SetBudget(int max_active, int max_shadowed)
+{
+	m_iMaxActive = MAX(max_active, 0);
+	m_iMaxShadowed = MAX(max_shadowed, 0);
+}
+
+void LLightBudget::Reset(int nLights)
+{
+	int old_size = m_Entries.size();
+	if (old_size == nLights)
+		return;
+
+	m_Entries.resize(nLights);
+
+	for (int n=old_size; n<nLights; n++)
+	{
+		LEntry &e = m_Entries[n];
+		e.m_bActive = false;
+		e.m_bShadowed = false;
+		e.m_bShadowOff = false;
+	}
+}
+
+void LLightBudget::SetShadow(LRoomManager &manager, int light_id, bool bShadow)
+{
+	LEntry &e = m_Entries[light_id];
+
+	// only lights that had shadows are touched
+	if (bShadow == !e.m_bShadowOff)
+		return;
+
+	Light * pLight = manager.m_Lights[light_id].GetGodotLight();
+	if (!pLight)
+		return;
+
+	if (!bShadow && !pLight->has_shadow())
+		return;
+
+	pLight->set_shadow(bShadow);
+	e.m_bShadowOff = !bShadow;
+}
+
+void LLightBudget::Restore(LRoomManager &manager)
+{
+	int nLights = MIN(m_Entries.size(), manager.m_Lights.size());
+	for (int n=0; n<nLights; n++)
+		SetShadow(manager, n, true);
+
+	m_Entries.clear();
+	m_Candidates.clear();
+	m_iNumCandidates = 0;
+	m_iNumCulled = 0;
+	m_iNumShadowsOff = 0;
+}
+
+void LLightBudget::Light_Release(LRoomManager &manager, int light_id)
+{
+	if (light_id >= m_Entries.size())
+		return;
+
+	SetShadow(manager, light_id, true);
+
+	LEntry &e = m_Entries[light_id];
+	e.m_bActive = false;
+	e.m_bShadowed = false;
+	e.m_bShadowOff = false;
+}
+
+// most important first, the list of active lights is usually small
+void LLightBudget::SortCandidates()
+{
+	for (int n=1; n<m_Candidates.size(); n++)
+	{
+		LCandidate c = m_Candidates[n];
+
+		int i = n - 1;
+		while ((i >= 0) && (m_Candidates[i].m_fImportance < c.m_fImportance))
+		{
+			m_Candidates[i + 1] = m_Candidates[i];
+			i--;
+		}
+
+		m_Candidates[i + 1] = c;
+	}
+}
+
+// the larger the reach of the light appears from the camera, the more noticeable it is
+float LLightBudget::CalculateImportance(LRoomManager &manager, int light_id, const Vector3 &ptCam) const
+{
+	LLight &light = manager.m_Lights[light_id];
+	const LSource &source = light.m_Source;
+
+	// global lights are never culled
+	if (source.IsGlobal())
+		return FLT_MAX;
+
+	float energy = 1.0f;
+	Light * pLight = light.GetGodotLight();
+	if (pLight)
+		energy = MAX(pLight->get_param(Light::PARAM_ENERGY), 0.0f);
+
+	// projected size of the light's sphere of influence, the camera may be inside it
+	float range = MAX(source.m_fRange, 0.01f);
+	float dist = MAX(source.m_ptPos.distance_to(ptCam), range);
+	float projected = (range * range) / (dist * dist);
+
+	// a light reaching more of the visible rooms (through the visible portals) lights more of the view
+	int nVisible = 0;
+	for (int n=0; n<light.m_NumAffectedRooms; n++)
+	{
+		if (manager.m_BF_visible_rooms.GetBit(light.m_AffectedRooms[n]))
+			nVisible++;
+	}
+
+	float reach = (float) (nVisible + 1) / (float) (light.m_NumAffectedRooms + 1);
+
+	return energy * projected * reach;
+}
+
+void LLightBudget::Apply(LRoomManager &manager, const Vector3 &ptCam)
+{
+	Reset(manager.m_Lights.size());
+
+	LVector<int> &active = manager.m_ActiveLights;
+	int nActive = active.size();
+
+	m_iNumCandidates = nActive;
+	m_iNumCulled = 0;
+	m_iNumShadowsOff = 0;
+
+	m_Candidates.resize(nActive);
+	for (int n=0; n<nActive; n++)
+	{
+		int lid = active[n];
+		LCandidate &c = m_Candidates[n];
+		c.m_iLightID = lid;
+		c.m_fImportance = CalculateImportance(manager, lid, ptCam);
+
+		if (m_Entries[lid].m_bActive && (c.m_fImportance != FLT_MAX))
+			c.m_fImportance *= LLIGHT_BUDGET_HYSTERESIS;
+	}
+
+	SortCandidates();
+
+	int max_active = m_iMaxActive ? MIN(m_iMaxActive, nActive) : nActive;
+
+	// godot only allows so many lights per object, the rest are dropped
+	for (int n=0; n<nActive; n++)
+	{
+		int lid = m_Candidates[n].m_iLightID;
+		bool bKeep = (n < max_active) || (m_Candidates[n].m_fImportance == FLT_MAX);
+
+		m_Entries[lid].m_bActive = bKeep;
+
+		if (!bKeep)
+		{
+			manager.m_BF_ActiveLights.SetBit(lid, false);
+			m_iNumCulled++;
+		}
+	}
+
+	// rebuild the active list in order of importance
+	active.clear();
+	for (int n=0; n<nActive; n++)
+	{
+		int lid = m_Candidates[n].m_iLightID;
+		if (m_Entries[lid].m_bActive)
+			active.push_back(lid);
+	}
+
+	if (!m_iMaxShadowed)
+	{
+		for (int n=0; n<active.size(); n++)
+			SetShadow(manager, active[n], true);
+		return;
+	}
+
+	// lights shadowed last frame get the bonus for the shadow budget, so the ranking is redone
+	int nKept = active.size();
+	m_Candidates.resize(nKept);
+	for (int n=0; n<nKept; n++)
+	{
+		int lid = active[n];
+		LCandidate &c = m_Candidates[n];
+		c.m_iLightID = lid;
+		c.m_fImportance = CalculateImportance(manager, lid, ptCam);
+
+		if (m_Entries[lid].m_bShadowed && (c.m_fImportance != FLT_MAX))
+			c.m_fImportance *= LLIGHT_BUDGET_HYSTERESIS;
+	}
+
+	SortCandidates();
+
+	for (int n=0; n<nKept; n++)
+	{
+		int lid = m_Candidates[n].m_iLightID;
+		bool bShadow = (n < m_iMaxShadowed) || (m_Candidates[n].m_fImportance == FLT_MAX);
+
+		m_Entries[lid].m_bShadowed = bShadow;
+		SetShadow(manager, lid, bShadow);
+
+		if (!bShadow)
+			m_iNumShadowsOff++;
+	}
+}
+
+String LLightBudget::MakeDebugString() const
+{
+	String sz = "Light budget " + itos(m_iMaxActive) + " active, " + itos(m_iMaxShadowed) + " shadowed : ";
+	sz += itos(m_iNumCandidates) + " candidates, " + itos(m_iNumCulled) + " culled, " + itos(m_iNumShadowsOff) + " shadows off\n";
+
+	// the ranking, most important first
+	sz += "\tranking : ";
+	for (int n=0; n<m_Candidates.size(); n++)
+	{
+		const LCandidate &c = m_Candidates[n];
+		if (c.m_fImportance == FLT_MAX)
+			sz += itos(c.m_iLightID) + " (global) ";
+		else
+			sz += itos(c.m_iLightID) + " (" + String(Variant(c.m_fImportance)) + ") ";
+	}
+	sz += "\n";
+
+	return sz;
+}
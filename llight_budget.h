@@ -0,0 +1,84 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/vector3.h"
+
+class LRoomManager;
+
+// When many local lights can be seen at once, godot's per object light limits and shadow atlas get thrashed.
+// The budget ranks the active lights each frame by importance (intensity, and how large the reach of the
+// light appears from the camera) and turns off the least important, or just their shadows.
+// Lights already within the budget get a bonus, so lights near the cutoff don't flicker on and off.
+class LLightBudget
+{
+public:
+	LLightBudget();
+
+	// 0 is unlimited
+	void SetBudget(int max_active, int max_shadowed);
+	bool IsActive() const {return (m_iMaxActive > 0) || (m_iMaxShadowed > 0);}
+
+	// removes the lights over budget from the active lights, and turns shadows on and off
+	void Apply(LRoomManager &manager, const Vector3 &ptCam);
+
+	// turn back on any shadows the budget turned off
+	void Restore(LRoomManager &manager);
+
+	// when a light's godot node is released or replaced, give back its shadow and forget its state
+	void Light_Release(LRoomManager &manager, int light_id);
+
+	// stats for the debug string
+	String MakeDebugString() const;
+	int m_iNumCandidates;
+	int m_iNumCulled;
+	int m_iNumShadowsOff;
+
+private:
+	void Reset(int nLights);
+	float CalculateImportance(LRoomManager &manager, int light_id, const Vector3 &ptCam) const;
+	void SetShadow(LRoomManager &manager, int light_id, bool bShadow);
+	void SortCandidates();
+
+	struct LEntry
+	{
+		bool m_bActive; // kept last frame
+		bool m_bShadowed; // shadow kept last frame
+		bool m_bShadowOff; // shadow turned off by the budget
+	};
+
+	struct LCandidate
+	{
+		int m_iLightID;
+		float m_fImportance;
+	};
+
+	LVector<LEntry> m_Entries;
+	LVector<LCandidate> m_Candidates;
+
+	int m_iMaxActive;
+	int m_iMaxShadowed;
+};
@@ -0,0 +1,246 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "llight_layers.h"
+#include "lroom.h"
+#include "scene/3d/light.h"
+
+
+LLightLayers::LLightLayers()
+{
+	m_iCurrentRecord = -1;
+	m_iNumLayersUsed = 0;
+	m_iNumShared = 0;
+}
+
+void LLightLayers::Reset()
+{
+	for (int n=0; n<m_AppliedLayer.size(); n++)
+		m_AppliedLayer[n] = -1;
+}
+
+void LLightLayers::Light_Reset(int light_id)
+{
+	if (light_id < m_AppliedLayer.size())
+		m_AppliedLayer[light_id] = -1;
+}
+
+void LLightLayers::Prepare(int nLights, int nSOBs)
+{
+	// the light lookups are kept all -1 between frames
+	if (m_LightRecord.size() != nLights)
+	{
+		int old_size = m_AppliedLayer.size();
+		m_LightRecord.resize(nLights);
+		m_AppliedLayer.resize(nLights);
+
+		for (int n=0; n<nLights; n++)
+			m_LightRecord[n] = -1;
+		for (int n=old_size; n<nLights; n++)
+			m_AppliedLayer[n] = -1;
+	}
+	else
+	{
+		for (int n=0; n<m_Records.size(); n++)
+			m_LightRecord[m_Records[n].m_LightID] = -1;
+	}
+
+	// sob masks likewise
+	if (m_SOBMasks.size() != nSOBs)
+	{
+		m_SOBMasks.resize(nSOBs);
+		for (int n=0; n<nSOBs; n++)
+			m_SOBMasks[n] = 0;
+	}
+	else
+	{
+		for (int n=0; n<m_TouchedSOBs.size(); n++)
+			m_SOBMasks[m_TouchedSOBs[n]] = 0;
+	}
+
+	m_Records.clear();
+	m_Casters.clear();
+	m_TouchedSOBs.clear();
+	m_iCurrentRecord = -1;
+	m_iNumLayersUsed = 0;
+	m_iNumShared = 0;
+}
+
+int LLightLayers::AddRecord(int light_id)
+{
+	int id = m_Records.size();
+
+	LRecord * pRec = m_Records.request();
+	pRec->m_LightID = light_id;
+	pRec->m_iFirstCaster = m_Casters.size();
+	pRec->m_iNumCasters = 0;
+	pRec->m_aabb = AABB();
+	pRec->m_iLayer = -1;
+
+	m_LightRecord[light_id] = id;
+	return id;
+}
+
+void LLightLayers::Light_Begin(int light_id)
+{
+	// each light is only processed once per frame
+	assert (m_LightRecord[light_id] == -1);
+	m_iCurrentRecord = AddRecord(light_id);
+}
+
+void LLightLayers::Light_AddCaster(int sob_id, const AABB &bb)
+{
+	assert (m_iCurrentRecord != -1);
+	LRecord &rec = m_Records[m_iCurrentRecord];
+
+	if (!rec.m_iNumCasters)
+		rec.m_aabb = bb;
+	else
+		rec.m_aabb.merge_with(bb);
+
+	rec.m_iNumCasters++;
+	m_Casters.push_back(sob_id);
+}
+
+void LLightLayers::Assign(const LVector<int> &active_lights)
+{
+	m_iCurrentRecord = -1;
+	m_Order.clear();
+
+	for (int n=0; n<active_lights.size(); n++)
+	{
+		int light_id = active_lights[n];
+
+		// lights can be active without finding any casters (e.g. outside the room system)
+		int rec_id = m_LightRecord[light_id];
+		if (rec_id == -1)
+			rec_id = AddRecord(light_id);
+
+		// the lights with the most casters are the most expensive to share, so colour them first.
+		// Insertion sort, the active light list is short.
+		int num = m_Records[rec_id].m_iNumCasters;
+		int i = m_Order.size();
+		m_Order.push_back(rec_id);
+		while (i && (m_Records[m_Order[i-1]].m_iNumCasters < num))
+		{
+			m_Order[i] = m_Order[i-1];
+			i--;
+		}
+		m_Order[i] = rec_id;
+	}
+
+	uint32_t used = 0;
+
+	for (int n=0; n<m_Order.size(); n++)
+	{
+		LRecord &rec = m_Records[m_Order[n]];
+		rec.m_iLayer = ChooseLayer(m_Order[n], n);
+		used |= 1 << rec.m_iLayer;
+
+		uint32_t bit = 1 << (LRoom::LAYER_LIGHT_LAYERS_FIRST_BIT + rec.m_iLayer);
+
+		int last_caster = rec.m_iFirstCaster + rec.m_iNumCasters;
+		for (int c=rec.m_iFirstCaster; c<last_caster; c++)
+		{
+			int sob_id = m_Casters[c];
+			if (!m_SOBMasks[sob_id])
+				m_TouchedSOBs.push_back(sob_id);
+
+			m_SOBMasks[sob_id] |= bit;
+		}
+	}
+
+	for (int l=0; l<LRoom::NUM_LIGHT_LAYERS; l++)
+	{
+		if (used & (1 << l))
+			m_iNumLayersUsed++;
+	}
+}
+
+int LLightLayers::ChooseLayer(int record_id, int num_coloured)
+{
+	const LRecord &rec = m_Records[record_id];
+
+	// layers taken by already coloured lights with overlapping casters, and how many casters
+	// sharing each layer would add to this light's shadow map
+	uint32_t taken = 0;
+	int cost[LRoom::NUM_LIGHT_LAYERS];
+	for (int l=0; l<LRoom::NUM_LIGHT_LAYERS; l++)
+		cost[l] = 0;
+
+	if (rec.m_iNumCasters)
+	{
+		for (int n=0; n<num_coloured; n++)
+		{
+			const LRecord &other = m_Records[m_Order[n]];
+			if (!other.m_iNumCasters)
+				continue;
+
+			if (!rec.m_aabb.intersects_inclusive(other.m_aabb))
+				continue;
+
+			taken |= 1 << other.m_iLayer;
+			cost[other.m_iLayer] += other.m_iNumCasters;
+		}
+	}
+
+	// keep the previous layer if possible, to save changing the light cull mask
+	int prev = m_AppliedLayer[rec.m_LightID];
+	if ((prev != -1) && !(taken & (1 << prev)))
+		return prev;
+
+	for (int l=0; l<LRoom::NUM_LIGHT_LAYERS; l++)
+	{
+		if (!(taken & (1 << l)))
+			return l;
+	}
+
+	// more overlapping lights than layers, share the cheapest
+	m_iNumShared++;
+
+	int best = 0;
+	for (int l=1; l<LRoom::NUM_LIGHT_LAYERS; l++)
+	{
+		if (cost[l] < cost[best])
+			best = l;
+	}
+
+	return best;
+}
+
+void LLightLayers::UpdateLightMask(int light_id, Light * pLight)
+{
+	int rec_id = m_LightRecord[light_id];
+	if (rec_id == -1)
+		return;
+
+	int layer = m_Records[rec_id].m_iLayer;
+	if (layer == m_AppliedLayer[light_id])
+		return;
+
+	m_AppliedLayer[light_id] = layer;
+
+	// 1 is for lighting objects outside the room system, the light bit is still used by the dobs
+	pLight->set_cull_mask(1 | LRoom::LAYER_MASK_LIGHT | (1 << (LRoom::LAYER_LIGHT_LAYERS_FIRST_BIT + layer)));
+}
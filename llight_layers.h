@@ -0,0 +1,98 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/aabb.h"
+
+class Light;
+
+// Godot renders a shadow map with every object whose layer matches the light cull mask.
+// With a single light layer bit every shadowed light draws the casters of every other light
+// (at least those within its own frustum). Instead each active light can be given one of a few spare
+// layer bits, and the casters only the bits of the lights they cast for. Lights whose casters overlap
+// are given different bits where possible (greedy colouring), lights far apart can share.
+class LLightLayers
+{
+public:
+	LLightLayers();
+
+	// called each frame before the lights are processed
+	void Prepare(int nLights, int nSOBs);
+
+	// record the casters found for each light
+	void Light_Begin(int light_id);
+	void Light_AddCaster(int sob_id, const AABB &bb);
+
+	// once all the lights are processed, choose a layer for each active light
+	void Assign(const LVector<int> &active_lights);
+
+	// layer bits for a caster
+	uint32_t GetSOBMask(int sob_id) const {return m_SOBMasks[sob_id];}
+
+	// only touches the visual server if the light layer has changed
+	void UpdateLightMask(int light_id, Light * pLight);
+
+	// forget the applied masks, e.g. after the lights are restored to the default cull mask
+	void Reset();
+
+	// likewise for one light, when its godot node is released or replaced
+	void Light_Reset(int light_id);
+
+	// stats for the debug string
+	int m_iNumLayersUsed;
+	int m_iNumShared;
+
+private:
+	int AddRecord(int light_id);
+	int ChooseLayer(int record_id, int num_coloured);
+
+	struct LRecord
+	{
+		int m_LightID;
+		int m_iFirstCaster;
+		int m_iNumCasters;
+		AABB m_aabb;
+		int m_iLayer;
+	};
+
+	LVector<LRecord> m_Records;
+	LVector<int> m_Casters;
+
+	// record for each light, or -1
+	LVector<int> m_LightRecord;
+
+	// layer applied to each godot light, or -1 for the default cull mask
+	LVector<int> m_AppliedLayer;
+
+	// records in colouring order
+	LVector<int> m_Order;
+
+	// layer bits per sob, the touched list is used to blank them
+	LVector<uint32_t> m_SOBMasks;
+	LVector<int> m_TouchedSOBs;
+
+	int m_iCurrentRecord;
+};
@@ -0,0 +1,151 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "llight_scheduler.h"
+#include "lroom_manager.h"
+#include "core/os/os.h"
+
+
+LLightScheduler::LLightScheduler()
+{
+	m_iBudget_usec = 0;
+	m_iNumProcessed = 0;
+	m_iTime_usec = 0;
+}
+
+// keep in step with the manager light list, preserving the entries of existing lights
+void LLightScheduler::Reset(int nLights)
+{
+	int old_size = m_Entries.size();
+	if (old_size == nLights)
+		return;
+
+	m_Entries.resize(nLights);
+
+	for (int n=old_size; n<nLights; n++)
+	{
+		LEntry &e = m_Entries[n];
+		e.m_bPending = false;
+		e.m_bCastersValid = false;
+		e.m_uiFrameRequested = 0;
+		e.m_ptTracedPos = Vector3(0, 0, 0);
+		e.m_Casters.clear();
+		e.m_Rooms.clear();
+	}
+
+	// remove any pending lights that no longer exist
+	for (int n=m_Pending.size()-1; n>=0; n--)
+	{
+		if (m_Pending[n] >= nLights)
+			m_Pending.remove_unsorted(n);
+	}
+}
+
+void LLightScheduler::Request(int light_id, unsigned int uiFrame)
+{
+	LEntry &e = m_Entries[light_id];
+	if (e.m_bPending)
+		return;
+
+	e.m_bPending = true;
+	e.m_uiFrameRequested = uiFrame;
+	m_Pending.push_back(light_id);
+}
+
+void LLightScheduler::StoreCasters(int light_id, const LVector<int> &casters, const LVector<int> &rooms)
+{
+	LEntry &e = m_Entries[light_id];
+	e.m_Casters.copy_from(casters);
+	e.m_Rooms.copy_from(rooms);
+	e.m_bCastersValid = true;
+}
+
+float LLightScheduler::CalculatePriority(const LRoomManager &manager, int light_id, const Vector3 &ptCam, unsigned int uiFrame) const
+{
+	const LLight &light = manager.m_Lights[light_id];
+	const LEntry &e = m_Entries[light_id];
+
+	float range = MAX(light.m_Source.m_fRange, 0.01f);
+
+	// lights that were lighting the view last frame are the most noticeable if they are out of date
+	float priority = manager.m_BF_ActiveLights_prev.GetBit(light_id) ? 4.0f : 1.0f;
+
+	// the further it has moved relative to its range, the more out of date the affected rooms
+	priority *= 1.0f + (light.m_Source.m_ptPos.distance_to(e.m_ptTracedPos) / range);
+
+	// lights far from the camera are less likely to be noticed
+	float dist_outside = MAX(light.m_Source.m_ptPos.distance_to(ptCam) - range, 0.0f);
+	priority /= 1.0f + (dist_outside / range);
+
+	// age, so that no light waits forever
+	priority *= 1.0f + ((uiFrame - e.m_uiFrameRequested) * 0.5f);
+
+	return priority;
+}
+
+void LLightScheduler::Process(LRoomManager &manager, const Vector3 &ptCam)
+{
+	m_iNumProcessed = 0;
+	m_iTime_usec = 0;
+
+	int nPending = m_Pending.size();
+	if (!nPending)
+		return;
+
+	unsigned int uiFrame = manager.m_uiFrameCounter;
+
+	m_Priorities.resize(nPending);
+	for (int n=0; n<nPending; n++)
+		m_Priorities[n] = CalculatePriority(manager, m_Pending[n], ptCam, uiFrame);
+
+	uint64_t start = OS::get_singleton()->get_ticks_usec();
+
+	while (m_Pending.size())
+	{
+		// always process at least one light per frame, so the budget can't stall updates
+		if (m_iNumProcessed && IsActive() && (m_iTime_usec >= m_iBudget_usec))
+			break;
+
+		// find the highest priority, the pending list is usually small
+		int best = 0;
+		for (int n=1; n<m_Pending.size(); n++)
+		{
+			if (m_Priorities[n] > m_Priorities[best])
+				best = n;
+		}
+
+		int light_id = m_Pending[best];
+		m_Pending.remove_unsorted(best);
+		m_Priorities.remove_unsorted(best);
+
+		LEntry &e = m_Entries[light_id];
+		e.m_bPending = false;
+		e.m_ptTracedPos = manager.m_Lights[light_id].m_Source.m_ptPos;
+
+		manager.Light_RetraceAffectedRooms(light_id);
+
+		m_iNumProcessed++;
+		m_iTime_usec = (int) (OS::get_singleton()->get_ticks_usec() - start);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/vector3.h"
+
+class LRoomManager;
+
+// When lots of dynamic lights move on the same frame, retracing them all at once can cause a spike.
+// Instead dynamic_light_update just marks the light as pending, and the scheduler retraces
+// the most important pending lights each frame within a time budget.
+// Lights that miss their turn keep their previous results (plus their current room) until they are retraced.
+class LLightScheduler
+{
+public:
+	LLightScheduler();
+
+	// 0 is unlimited, lights are retraced immediately in dynamic_light_update
+	void SetBudget(int budget_usec) {m_iBudget_usec = budget_usec;}
+	bool IsActive() const {return m_iBudget_usec > 0;}
+
+	void Reset(int nLights);
+
+	// mark a light as having moved
+	void Request(int light_id, unsigned int uiFrame);
+
+	// retrace the highest priority pending lights
+	void Process(LRoomManager &manager, const Vector3 &ptCam);
+
+	bool IsPending(int light_id) const {return m_Entries[light_id].m_bPending;}
+
+	// the last caster trace for each light is kept, for use while it waits
+	void StoreCasters(int light_id, const LVector<int> &casters, const LVector<int> &rooms);
+	bool HasCasters(int light_id) const {return m_Entries[light_id].m_bCastersValid;}
+	const LVector<int> &GetCasters(int light_id) const {return m_Entries[light_id].m_Casters;}
+	const LVector<int> &GetCasterRooms(int light_id) const {return m_Entries[light_id].m_Rooms;}
+
+	// stats for the debug string
+	int GetNumPending() const {return m_Pending.size();}
+	int m_iNumProcessed;
+	int m_iTime_usec;
+
+private:
+	float CalculatePriority(const LRoomManager &manager, int light_id, const Vector3 &ptCam, unsigned int uiFrame) const;
+
+	struct LEntry
+	{
+		bool m_bPending;
+		bool m_bCastersValid;
+		unsigned int m_uiFrameRequested;
+
+		// where the light was when the rooms were last traced
+		Vector3 m_ptTracedPos;
+
+		// results of the last caster trace
+		LVector<int> m_Casters;
+		LVector<int> m_Rooms;
+	};
+
+	LVector<LEntry> m_Entries;
+	LVector<int> m_Pending;
+	LVector<float> m_Priorities;
+
+	int m_iBudget_usec;
+};
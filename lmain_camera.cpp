@@ -879,7 +879,82 @@ bool LMainCamera::AddCameraLightPlanes(LRoomManager &manager, const LSource &lso
 bool LMainCamera::Prepare(LRoomManager &manager, Camera * pCam)
 {
 	m_Planes.copy_from(pCam->get_frustum());
+	m_ptPos = pCam->get_global_transform().origin;
 
+	if (!CalculatePoints())
+		return false;
+
+#define PUSH_PT(a) manager.m_DebugFrustums.push_back(m_Points[a])
+
+	if (manager.m_bDebugFrustums)
+	{
+		PUSH_PT(PT_NEAR_LEFT_TOP);
+		PUSH_PT(PT_FAR_LEFT_TOP);
+		PUSH_PT(PT_NEAR_RIGHT_TOP);
+		PUSH_PT(PT_FAR_RIGHT_TOP);
+		PUSH_PT(PT_NEAR_LEFT_BOTTOM);
+		PUSH_PT(PT_FAR_LEFT_BOTTOM);
+		PUSH_PT(PT_NEAR_RIGHT_BOTTOM);
+		PUSH_PT(PT_FAR_RIGHT_BOTTOM);
+	}
+
+
+	return true;
+}
+
+// Pushing every plane outward gives a larger frustum of the same shape, which stays well formed
+// because the side planes close behind the camera further back than the near plane moves.
+bool LMainCamera::CreateExpanded(const LMainCamera &cam, float margin)
+{
+	m_Planes.copy_from(cam.m_Planes);
+	m_ptPos = cam.m_ptPos;
+
+	for (int n=0; n<m_Planes.size(); n++)
+		m_Planes[n].d += margin;
+
+	return CalculatePoints();
+}
+
+bool LMainCamera::CreateSlice(const LMainCamera &cam, float near_dist, float far_dist)
+{
+	m_Planes.copy_from(cam.m_Planes);
+	m_ptPos = cam.m_ptPos;
+
+	// the plane normals face out of the frustum, so the near normal faces back towards the camera
+	Vector3 ptForward = -m_Planes[P_NEAR].normal;
+
+	// the slice can't extend beyond the original frustum
+	near_dist = MAX(near_dist, m_Planes[P_NEAR].distance_to(m_ptPos));
+	far_dist = MIN(far_dist, -m_Planes[P_FAR].distance_to(m_ptPos));
+
+	if (near_dist >= far_dist)
+		return false;
+
+	m_Planes[P_NEAR] = Plane(m_ptPos + (ptForward * near_dist), -ptForward);
+	m_Planes[P_FAR] = Plane(m_ptPos + (ptForward * far_dist), ptForward);
+
+	return CalculatePoints();
+}
+
+bool LMainCamera::ContainsFrustum(const LMainCamera &cam) const
+{
+	// the frustum is convex, so it is contained if all the corners are
+	for (int p=0; p<m_Planes.size(); p++)
+	{
+		const Plane &plane = m_Planes[p];
+
+		for (int n=0; n<NUM_CAM_POINTS; n++)
+		{
+			if (plane.distance_to(cam.m_Points[n]) > 0.0f)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool LMainCamera::CalculatePoints()
+{
 	if (m_Points.size() != 8)
 		m_Points.resize(8);
 
@@ -914,21 +989,6 @@ bool LMainCamera::Prepare(LRoomManager &manager, Camera * pCam)
 
 	m_ptCentre *= 1.0f / 8.0f;
 
-#define PUSH_PT(a) manager.m_DebugFrustums.push_back(m_Points[a])
-
-	if (manager.m_bDebugFrustums)
-	{
-		PUSH_PT(PT_NEAR_LEFT_TOP);
-		PUSH_PT(PT_FAR_LEFT_TOP);
-		PUSH_PT(PT_NEAR_RIGHT_TOP);
-		PUSH_PT(PT_FAR_RIGHT_TOP);
-		PUSH_PT(PT_NEAR_LEFT_BOTTOM);
-		PUSH_PT(PT_FAR_LEFT_BOTTOM);
-		PUSH_PT(PT_NEAR_RIGHT_BOTTOM);
-		PUSH_PT(PT_FAR_RIGHT_BOTTOM);
-	}
-
-
 	return true;
 }
 
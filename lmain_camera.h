@@ -68,13 +68,25 @@ public:
 	// main use of this object, we can create a clipping volume that is a mix of the light frustum and the camera volume
 	bool AddCameraLightPlanes(LRoomManager &manager, const LSource &lsource, LVector<Plane> &planes) const;
 
+	// a conservative larger volume around another camera, used for caching results between frames
+	bool CreateExpanded(const LMainCamera &cam, float margin);
+	bool ContainsFrustum(const LMainCamera &cam) const;
+
+	// the part of another camera frustum between two distances from the camera (e.g. a shadow split)
+	bool CreateSlice(const LMainCamera &cam, float near_dist, float far_dist);
+
 	LVector<Plane> m_Planes;
 	LVector<Vector3> m_Points;
 
 	// centre of camera frustum
 	Vector3 m_ptCentre;
 
+	// camera position
+	Vector3 m_ptPos;
+
 private:
+	// derive the frustum corners from the planes
+	bool CalculatePoints();
 	bool AddCameraLightPlanes_Directional(LRoomManager &manager, const LSource &lsource, LVector<Plane> &planes) const;
 	String String_PlaneBF(unsigned int BF);
 
@@ -23,6 +23,7 @@
 #include "lroom.h"
 #include "ldebug.h"
 #include "lroom_manager.h"
+#include "ldedup.h"
 
 /////////////////////////////////////////////////////////////////////
 
@@ -235,6 +236,7 @@ void LPortal::CreateGeometry(PoolVector<Vector3> p_vertices, const Transform &tr
 	ERR_FAIL_COND(nPoints < 3);
 
 	m_ptsWorld.clear();
+	LPointDedup dedup(0.001f);
 
 	//print("\t\t\tLPortal::CreateGeometry nPoints : " + itos(nPoints));
 
@@ -250,18 +252,7 @@ void LPortal::CreateGeometry(PoolVector<Vector3> p_vertices, const Transform &tr
 
 		// new!! test for duplicates. Some geometry may contain duplicate verts in portals which will muck up
 		// the winding etc...
-		bool bDuplicate = false;
-		for (int m=0; m<m_ptsWorld.size(); m++)
-		{
-			Vector3 ptDiff = ptWorld - m_ptsWorld[m];
-			if (ptDiff.length() < 0.001f)
-			{
-				bDuplicate = true;
-				break;
-			}
-		}
-
-		if (!bDuplicate)
+		if (dedup.AddIfUnique(ptWorld))
 		{
 			m_ptsWorld.push_back(ptWorld);
 			m_ptCentre += ptWorld;
@@ -387,6 +378,190 @@ void LPortal::CopyReversedGeometry(const LPortal &source)
 	PlaneFromPoints();
 }
 
+// Portal meshes from artists can have many more verts than needed (arches, bevels etc), and each vert adds
+// a plane to every cull through the portal. The simplified polygon only ever contains the original,
+// so nothing that could be seen through the portal is culled.
+int LPortal::Simplify(int iMaxVerts)
+{
+	int nPoints = m_ptsWorld.size();
+	if (nPoints < 3)
+		return nPoints;
+
+	// 2d coordinates in the portal plane
+	Vector3 ptNormal = m_Plane.normal;
+	Vector3 ptAxis = (Math::abs(ptNormal.x) < 0.9f) ? Vector3(1, 0, 0) : Vector3(0, 1, 0);
+	Vector3 ptU = ptNormal.cross(ptAxis).normalized();
+	Vector3 ptV = ptNormal.cross(ptU);
+	Vector3 ptOrigin = ptNormal * m_Plane.d;
+
+	LVector<Vector2> pts;
+	for (int n=0; n<nPoints; n++)
+	{
+		Vector3 pt = m_ptsWorld[n] - ptOrigin;
+		pts.push_back(Vector2(pt.dot(ptU), pt.dot(ptV)));
+	}
+
+	LVector<Vector2> hull;
+	if (!Simplify_ConvexHull(pts, hull))
+		return nPoints;
+
+	// a quad can't always be reduced by extending edges (e.g. a rectangle)
+	if (iMaxVerts > 0)
+	{
+		iMaxVerts = MAX(iMaxVerts, 4);
+		while (hull.size() > iMaxVerts)
+		{
+			if (!Simplify_RemoveEdge(hull))
+				break;
+		}
+	}
+
+	m_ptsWorld.resize(hull.size());
+	m_ptCentre = Vector3(0, 0, 0);
+	for (int n=0; n<hull.size(); n++)
+	{
+		Vector3 pt = ptOrigin + (ptU * hull[n].x) + (ptV * hull[n].y);
+		m_ptsWorld.set(n, pt);
+		m_ptCentre += pt;
+	}
+	m_ptCentre /= hull.size();
+
+	// keep the winding, which determines the portal normal
+	Plane plane = Plane(m_ptsWorld[0], m_ptsWorld[1], m_ptsWorld[2]);
+	if (plane.normal.dot(ptNormal) < 0.0f)
+		ReverseWindingOrder();
+
+	PlaneFromPoints();
+	return nPoints;
+}
+
+// gift wrapping, the portals have few verts. Collinear verts are dropped, and the hull is anticlockwise.
+bool LPortal::Simplify_ConvexHull(const LVector<Vector2> &pts, LVector<Vector2> &hull)
+{
+	const float epsilon = 0.00001f;
+	int nPoints = pts.size();
+
+	int start = 0;
+	for (int n=1; n<nPoints; n++)
+	{
+		if ((pts[n].x < pts[start].x) || ((pts[n].x == pts[start].x) && (pts[n].y < pts[start].y)))
+			start = n;
+	}
+
+	hull.clear();
+	int p = start;
+	do
+	{
+		// shouldn't happen, but prevent an infinite loop with bad data
+		if (hull.size() == nPoints)
+			return false;
+
+		hull.push_back(pts[p]);
+
+		int q = (p + 1) % nPoints;
+		for (int r=0; r<nPoints; r++)
+		{
+			if (r == p)
+				continue;
+
+			Vector2 ptQ = pts[q] - pts[p];
+			Vector2 ptR = pts[r] - pts[p];
+			float c = ptQ.cross(ptR);
+
+			// r is to the right, or collinear and further, so q is not on the hull
+			if ((c < -epsilon) || ((c <= epsilon) && (ptR.length_squared() > ptQ.length_squared())))
+				q = r;
+		}
+
+		p = q;
+	} while (p != start);
+
+	return hull.size() >= 3;
+}
+
+// Removes the edge that adds the least area when the edges either side are extended to meet
+// in place of it. Edges where the neighbours don't converge can't be removed.
+bool LPortal::Simplify_RemoveEdge(LVector<Vector2> &hull)
+{
+	int nVerts = hull.size();
+
+	int best = -1;
+	float best_area = FLT_MAX;
+	Vector2 ptBest;
+
+	for (int n=0; n<nVerts; n++)
+	{
+		const Vector2 &ptPrev = hull[(n + nVerts - 1) % nVerts];
+		const Vector2 &ptA = hull[n];
+		const Vector2 &ptB = hull[(n + 1) % nVerts];
+		const Vector2 &ptNext = hull[(n + 2) % nVerts];
+
+		Vector2 ptDirA = ptA - ptPrev;
+		Vector2 ptDirB = ptNext - ptB;
+
+		float denom = ptDirA.cross(ptDirB);
+		if (denom <= 0.00001f)
+			continue;
+
+		// extend out from A, and back from B
+		float t = (ptB - ptA).cross(ptDirB) / denom;
+		if (t < 0.0f)
+			continue;
+
+		Vector2 pt = ptA + (ptDirA * t);
+		float area = Math::abs((pt - ptA).cross(ptB - ptA)) * 0.5f;
+
+		if (area < best_area)
+		{
+			best_area = area;
+			best = n;
+			ptBest = pt;
+		}
+	}
+
+	if (best == -1)
+		return false;
+
+	// A is replaced by the new point and B removed
+	hull[best] = ptBest;
+	int remove = (best + 1) % nVerts;
+	for (int n=remove; n<nVerts-1; n++)
+		hull[n] = hull[n+1];
+
+	hull.resize(nVerts-1);
+	return true;
+}
+
+// works for either winding order, the centre is always inside
+bool LPortal::IsPointWithin(const Vector3 &pt, float margin) const
+{
+	int nPoints = m_ptsWorld.size();
+	if (nPoints < 3)
+		return false;
+
+	for (int n=0; n<nPoints; n++)
+	{
+		const Vector3 &pt0 = m_ptsWorld[n];
+		const Vector3 &pt1 = m_ptsWorld[(n + 1) % nPoints];
+
+		// perpendicular to the edge, in the portal plane
+		Vector3 ptEdgeNormal = (pt1 - pt0).cross(m_Plane.normal);
+		float l = ptEdgeNormal.length();
+		if (l < 0.00001f)
+			continue;
+		ptEdgeNormal /= l;
+
+		float d = ptEdgeNormal.dot(pt - pt0);
+		if (ptEdgeNormal.dot(m_ptCentre - pt0) < 0.0f)
+			d = -d;
+
+		if (d < -margin)
+			return false;
+	}
+
+	return true;
+}
+
 void LPortal::PlaneFromPoints()
 {
 	if (m_ptsWorld.size() < 3)
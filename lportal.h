@@ -61,6 +61,9 @@ public:
 	// (the planes will need reversing because the portal winding will be opposite)
 	void AddLightPlanes(LRoomManager &manager, const LLight &light, LVector<Plane> &planes, bool bReverse) const;
 
+	// is a point on the portal plane within the portal polygon (expanded by the margin)
+	bool IsPointWithin(const Vector3 &pt, float margin) const;
+
 	// normal determined by winding order
 	Vector<Vector3> m_ptsWorld;
 	Vector3 m_ptCentre; // world
@@ -81,12 +84,19 @@ public:
 	void SortVertsClockwise(bool bPortalPlane_Convention);
 	void ReverseWindingOrder();
 
+	// replace the polygon with its convex hull in the portal plane, reduced to at most iMaxVerts (0 for no limit).
+	// Returns the number of verts before.
+	int Simplify(int iMaxVerts);
+
 	// useful funcs
 	static bool NameStartsWith(const Node * pNode, String szSearch);
 	static String FindNameAfter(Node * pNode, String szStart);
 
 private:
 	void Debug_CheckPlaneValidity(const Plane &p) const;
+
+	static bool Simplify_ConvexHull(const LVector<Vector2> &pts, LVector<Vector2> &hull);
+	static bool Simplify_RemoveEdge(LVector<Vector2> &hull);
 };
 
 
@@ -9,7 +9,6 @@
 #define LDEBUG_LIGHT_AFFECTED_ROOMS
 //#define LDEBUG_DOB_VISIBILITY
 
-#define LPORTAL_DOBS_NO_SOFTSHOW
 //#define LPORTAL_DOBS_AUTO_UPDATE
 
 //#define LDEBUG_UNMERGE
@@ -32,4 +31,12 @@
 #include "lmain_camera.cpp"
 #include "larea.cpp"
 #include "ldae_exporter.cpp"
+#include "lshadow_receivers.cpp"
+#include "llight_scheduler.cpp"
+#include "llight_layers.cpp"
+#include "lsun_grid.cpp"
+#include "lroom_grid.cpp"
+#include "llight_budget.cpp"
+#include "lconvert_cache.cpp"
+#include "ldedup.cpp"
 
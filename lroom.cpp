@@ -33,12 +33,15 @@ LRoom::LRoom() {
 	m_iFirstPortal = 0;
 	m_iNumPortals = 0;
 	m_bVisible = true;
+	m_bLoaded = true;
 
 	m_iFirstSOB = 0;
 	m_iNumSOBs = 0;
 
 	m_iFirstShadowCaster_SOB = 0;
 	m_iNumShadowCasters_SOB = 0;
+
+	m_iFirstDOB = -1;
 }
 
 
@@ -178,6 +181,10 @@ void LRoom::SoftShow(VisualInstance * pVI, uint32_t show_flags)
 	else
 		mask &= ~LAYER_MASK_LIGHT;
 
+	// per light caster layers, none if light layers are not in use
+	mask &= ~LAYER_MASK_LIGHT_LAYERS;
+	mask |= show_flags & LAYER_MASK_LIGHT_LAYERS;
+
 //	if (bShow)
 //	{
 //		// set
@@ -321,42 +328,6 @@ void LRoom::FinalizeVisibility(LRoomManager &manager)
 
 	//print_line("FinalizeVisibility room " + get_name() + " NumSOBs " + itos(m_SOBs.size()) + ", NumDOBs " + itos(m_DOBs.size()));
 
-#ifndef LPORTAL_DOBS_NO_SOFTSHOW
-	for (int n=0; n<m_DOBs.size(); n++)
-	{
-		const LDob &dob = m_DOBs[n];
-
-		// don't cull the main camera
-		//if (dob.m_ID_Spatial == manager.m_ID_camera)
-		//	continue;
-
-		VisualInstance * pVI = dob.GetVI();
-		if (pVI)
-		{
-			uint32_t mask = 0;
-			if (dob.m_bVisible)
-			{
-				mask = LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT;
-			}
-			else
-			{
-				// special case
-				// don't cull the main camera
-				if (dob.m_ID_Spatial == manager.m_ID_camera)
-					mask = LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT;
-			}
-
-			SoftShow(pVI, mask);
-//			if (dob.m_bVisible)
-//			{
-//				//print("LRoom::FinalizeVisibility making visible dob " + pS->get_name());
-//				pS->show();
-//			}
-//			else
-//				pS->hide();
-		}
-	}
-#endif
 
 }
 
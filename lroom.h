@@ -53,12 +53,18 @@ public:
 	static const int LAYER_MASK_LIGHT = 1 << LAYER_LIGHT_BIT;
 	static const int LAYER_MASK_CAMERA = 1 << LAYER_CAMERA_BIT;
 
+	// optional per light caster layers (see LLightLayers), using the spare bits below the light bit
+	static const int LAYER_LIGHT_LAYERS_FIRST_BIT = 10;
+	static const int NUM_LIGHT_LAYERS = 8;
+	static const int LAYER_MASK_LIGHT_LAYERS = ((1 << NUM_LIGHT_LAYERS) - 1) << LAYER_LIGHT_LAYERS_FIRST_BIT;
+
 	// static objects are stored in the manager in a contiguous list
 	int m_iFirstSOB;
 	int m_iNumSOBs;
 
-	// dynamic objects
-	//LVector<uint32_t> m_DOB_ids;
+	// dynamic objects currently within the room, the first dob slot of an intrusive list
+	// (see LDobList), or -1
+	int m_iFirstDOB;
 
 	// local lights affecting this room
 	LVector<int> m_LocalLights;
@@ -85,6 +91,9 @@ public:
 
 	ObjectID m_GodotID;
 
+	// false while the area containing the room is unloaded, portals into the room act as closed
+	bool m_bLoaded;
+
 	// frame counter when last touched .. prevents handling rooms multiple times
 	unsigned int m_uiFrameTouched;
 
@@ -115,11 +124,6 @@ public:
 	// naive version, adds all the non visible objects in visible rooms as shadow casters
 	void AddShadowCasters(LRoomManager &manager);
 
-//	void DOB_Add(int id);
-//	int DOB_GetID(unsigned int ui) const {return m_DOB_ids[ui];}
-//	unsigned int DOB_Find(int id) const;
-//	bool DOB_Remove(unsigned int ui);
-//	LRoom * DOB_Update(LRoomManager &manager, Spatial * pDOB);
 
 	LRoom();
 	Spatial * GetGodotRoom() const;
@@ -129,7 +133,9 @@ public:
 	void AddLocalLight(int light_id) {m_LocalLights.push_back(light_id);}
 
 	// retained purely for debugging visualization
+#ifdef DEBUG_ENABLED
 	Geometry::MeshData m_Bound_MeshData;
+#endif
 
 	bool IsVisible() const {return m_bVisible;}
 	// instead of directly showing and hiding objects we now set their layer,
@@ -26,6 +26,9 @@
 #include "core/math/quick_hull.h"
 #include "ldebug.h"
 #include "scene/3d/light.h"
+#include "core/os/os.h"
+#include "core/os/thread.h"
+#include "ldedup.h"
 
 // save typing, I am lazy
 #define LMAN m_pManager
@@ -33,11 +36,74 @@
 
 
 
+LRoomConverter::LRoomConverter()
+{
+	m_bReconvert = false;
+	m_bDeferNodeChanges = false;
+	m_pAsyncThread = 0;
+	m_iAsyncStep = 0;
+	m_bAsyncDone = false;
+}
+
+LRoomConverter::~LRoomConverter()
+{
+	Async_Wait();
+	Workers_Destroy();
+}
+
 void LRoomConverter::Convert(LRoomManager &manager, bool bVerbose, bool bPreparationRun, bool bDeleteLights, bool bSingleRoomMode)
+{
+	Convert_Begin(manager, bVerbose, bPreparationRun, bDeleteLights, bSingleRoomMode);
+	Convert_Gather();
+	Convert_Process();
+	Convert_End();
+}
+
+// The scene is read on the main thread, and the rest of the conversion is done on a thread.
+// Changes to the scene nodes are recorded and made in Async_End, back on the main thread.
+void LRoomConverter::Async_Begin(LRoomManager &manager, bool bVerbose, bool bDeleteLights, bool bSingleRoomMode)
+{
+	Convert_Begin(manager, bVerbose, false, bDeleteLights, bSingleRoomMode);
+	m_bDeferNodeChanges = true;
+	m_bAsyncDone = false;
+	m_iAsyncStep = 0;
+
+	Convert_Gather();
+
+	m_pAsyncThread = Thread::create(Async_ThreadFunc, this);
+}
+
+void LRoomConverter::Async_ThreadFunc(void * pUserData)
+{
+	LRoomConverter * pConv = (LRoomConverter *) pUserData;
+	pConv->Convert_Process();
+	pConv->m_bAsyncDone = true;
+}
+
+void LRoomConverter::Async_Wait()
+{
+	if (!m_pAsyncThread)
+		return;
+
+	Thread::wait_to_finish(m_pAsyncThread);
+	memdelete(m_pAsyncThread);
+	m_pAsyncThread = 0;
+}
+
+void LRoomConverter::Async_End()
+{
+	Async_Wait();
+	Convert_ApplyNodeChanges();
+	Convert_End();
+}
+
+void LRoomConverter::Convert_Begin(LRoomManager &manager, bool bVerbose, bool bPreparationRun, bool bDeleteLights, bool bSingleRoomMode)
 {
 	m_bFinalRun = (bPreparationRun == false);
 	m_bDeleteLights = bDeleteLights;
 	m_bSingleRoomMode = bSingleRoomMode;
+	m_bReconvert = false;
+	m_bDeferNodeChanges = false;
 
 	// This just is simply used to set how much debugging output .. more during conversion, less during running
 	// except when requested by explicitly clearing this flag.
@@ -64,19 +130,129 @@ void LRoomConverter::Convert(LRoomManager &manager, bool bVerbose, bool bPrepara
 
 	//int num_global_lights = LMAN->m_Lights.size();
 
-	// make sure bitfield is right size for number of rooms
-	LMAN->m_BF_visible_rooms.Create(count);
-	LMAN->m_LightRender.m_BF_Temp_Visible_Rooms.Create(count);
-
 	LMAN->m_Rooms.resize(count);
+	m_DeletedNodes.clear();
+	m_DetachedNodes.clear();
+	m_RoomNames.clear();
+	m_AreaNames.clear();
 
 	m_TempRooms.clear(true);
 	m_TempRooms.resize(count);
 
+	Workers_Create(bVerbose);
+	Timing_Begin();
+}
 
+// everything that reads from the scene tree
+void LRoomConverter::Convert_Gather()
+{
 	Convert_Rooms();
+	Timing_Phase("rooms");
+
+	for (int n=0; n<LMAN->m_Rooms.size(); n++)
+	{
+		LRoom_DetectPortalMeshes(LMAN->m_Rooms[n], m_TempRooms[n]);
+		Bound_Gather(n);
+	}
+	Timing_Phase("scene");
+	m_iAsyncStep++;
+}
+
+// works only on the gathered data, so can be run on a thread
+void LRoomConverter::Convert_Process()
+{
+	Optimize_Graph();
 	Convert_Portals();
+	Timing_Phase("portals");
+	m_iAsyncStep++;
 	Convert_Bounds();
+	Timing_Phase("bounds");
+	m_iAsyncStep++;
+
+	CreateRuntimeData(*LMAN);
+
+	// must be done after the bitfields
+	Convert_Lights();
+	Timing_Phase("lights");
+	m_iAsyncStep++;
+	Convert_ShadowCasters();
+	Timing_Phase("shadow casters");
+	m_iAsyncStep++;
+	Convert_AreaLights();
+	Timing_Phase("area lights");
+	m_iAsyncStep++;
+}
+
+void LRoomConverter::Convert_End()
+{
+	// for checking how conversion scales with level size
+	LPRINT(5, "LPortal converted " + itos(LMAN->m_Rooms.size()) + " rooms, " + itos(LMAN->m_SOBs.size()) + " objects, " + itos(LMAN->m_Lights.size()) + " lights in "
+			+ itos((OS::get_singleton()->get_ticks_usec() - m_uiTimingStart) / 1000) + " ms (" + m_szTimings + ")");
+
+	// hide all in preparation for first frame
+	//LMAN->ShowAll(false);
+
+	// temp rooms no longer needed
+	m_TempRooms.clear(true);
+	m_LightJobs.clear(true);
+	Workers_Destroy();
+
+	// clear out the local room lights, leave only global lights
+	//LMAN->m_Lights.resize(num_global_lights);
+	Lawn::LDebug::m_bRunning = true;
+}
+
+// the scene changes recorded during an async conversion
+void LRoomConverter::Convert_ApplyNodeChanges()
+{
+	for (int n=0; n<m_DetachedNodes.size(); n++)
+	{
+		Node * pNode = Object::cast_to<Node>(ObjectDB::get_instance(m_DetachedNodes[n]));
+		if (pNode && pNode->get_parent())
+			pNode->get_parent()->remove_child(pNode);
+	}
+
+	for (int n=0; n<m_DeletedNodes.size(); n++)
+	{
+		Node * pNode = Object::cast_to<Node>(ObjectDB::get_instance(m_DeletedNodes[n]));
+		if (pNode)
+			pNode->queue_delete();
+	}
+
+	// take away layer 0 from the sobs, so they can be culled effectively
+	if (m_bFinalRun)
+	{
+		for (int n=0; n<LMAN->m_SOBs.size(); n++)
+		{
+			VisualInstance * pVI = LMAN->m_SOBs[n].GetVI();
+			if (pVI)
+				pVI->set_layer_mask(0);
+		}
+	}
+
+	for (int n=0; n<LMAN->m_Lights.size(); n++)
+	{
+		Light * pLight = Object::cast_to<Light>(ObjectDB::get_instance(LMAN->m_Lights[n].m_GodotID));
+		if (pLight)
+			pLight->set_cull_mask(1 | LRoom::LAYER_MASK_LIGHT);
+	}
+
+	m_bDeferNodeChanges = false;
+}
+
+
+
+void LRoomConverter::CreateRuntimeData(LRoomManager &manager)
+{
+	LMAN = &manager;
+
+	// make sure bitfield is right size for number of rooms
+	int num_rooms = LMAN->m_Rooms.size();
+	LMAN->m_BF_visible_rooms.Create(num_rooms);
+	LMAN->m_LightRender.m_BF_Temp_Visible_Rooms.Create(num_rooms);
+
+	// room AABBs are final, index them for room lookups
+	LMAN->m_RoomGrid.Create(*LMAN);
 
 	// make sure manager bitfields are the correct size for number of objects
 	int num_sobs = LMAN->m_SOBs.size();
@@ -91,23 +267,118 @@ void LRoomConverter::Convert(LRoomManager &manager, bool bVerbose, bool bPrepara
 	LMAN->m_BF_ActiveLights.Create(LMAN->m_Lights.size());
 	LMAN->m_BF_ActiveLights_prev.Create(LMAN->m_Lights.size());
 	LMAN->m_BF_ProcessedLights.Create(LMAN->m_Lights.size());
+}
 
-	// must be done after the bitfields
-	Convert_Lights();
-	Convert_ShadowCasters();
-	Convert_AreaLights();
 
-	// hide all in preparation for first frame
-	//LMAN->ShowAll(false);
+void LRoomConverter::Timing_Begin()
+{
+	m_uiTimingStart = OS::get_singleton()->get_ticks_usec();
+	m_uiTimingLast = m_uiTimingStart;
+	m_szTimings = "";
+}
 
-	// temp rooms no longer needed
-	m_TempRooms.clear(true);
+void LRoomConverter::Timing_Phase(const String &szPhase)
+{
+	uint64_t now = OS::get_singleton()->get_ticks_usec();
 
-	// clear out the local room lights, leave only global lights
-	//LMAN->m_Lights.resize(num_global_lights);
-	Lawn::LDebug::m_bRunning = true;
+	if (m_szTimings != "")
+		m_szTimings += ", ";
+
+	m_szTimings += szPhase + " " + itos((now - m_uiTimingLast) / 1000) + " ms";
+	m_uiTimingLast = now;
+}
+
+void LRoomConverter::Workers_Create(bool bVerbose)
+{
+	Workers_Destroy();
+
+	int nThreads = CLAMP(OS::get_singleton()->get_processor_count(), 1, 16);
+
+	// verbose logging and the debug geometry should come out in order
+	if (bVerbose || LMAN->m_bDebugPlanes || LMAN->m_bDebugFrustums || LMAN->m_bDebugLights)
+		nThreads = 1;
+
+	for (int n=0; n<nThreads; n++)
+	{
+		LWorker * pWorker = memnew(LWorker);
+		pWorker->m_iID = n;
+		pWorker->m_pConverter = this;
+
+		// only a single thread can use the shared debug tab depth (verbose conversion is single threaded)
+		pWorker->m_Trace.Trace_SetTabDepth(nThreads == 1);
+		m_Workers.push_back(pWorker);
+	}
+
+	LPRINT(5, "Converting with " + itos(nThreads) + " threads");
+}
+
+// the worker bitfields are sized for the converted rooms and sobs
+void LRoomConverter::Workers_Prepare()
+{
+	int nRooms = LMAN->m_Rooms.size();
+	int nSOBs = LMAN->m_SOBs.size();
+	for (int n=0; n<m_Workers.size(); n++)
+	{
+		m_Workers[n]->m_BF_SOBs.Create(nSOBs);
+		m_Workers[n]->m_BF_Rooms.Create(nRooms);
+	}
+}
+
+void LRoomConverter::Workers_Destroy()
+{
+	for (int n=0; n<m_Workers.size(); n++)
+		memdelete(m_Workers[n]);
+
+	m_Workers.clear(true);
+}
+
+// each worker takes every nth job, the main thread doing a share too
+void LRoomConverter::Jobs_Run(eJob job, int nJobs)
+{
+	m_eJob = job;
+	m_iNumJobs = nJobs;
+	m_iNumJobThreads = MAX(MIN(m_Workers.size(), nJobs), 1);
+
+	for (int n=1; n<m_iNumJobThreads; n++)
+		m_Workers[n]->m_pThread = Thread::create(Jobs_ThreadFunc, m_Workers[n]);
+
+	Jobs_Worker(*m_Workers[0]);
+
+	for (int n=1; n<m_iNumJobThreads; n++)
+	{
+		Thread::wait_to_finish(m_Workers[n]->m_pThread);
+		memdelete(m_Workers[n]->m_pThread);
+		m_Workers[n]->m_pThread = 0;
+	}
+}
+
+void LRoomConverter::Jobs_ThreadFunc(void * pUserData)
+{
+	LWorker * pWorker = (LWorker *) pUserData;
+	pWorker->m_pConverter->Jobs_Worker(*pWorker);
 }
 
+void LRoomConverter::Jobs_Worker(LWorker &w)
+{
+	for (int n=w.m_iID; n<m_iNumJobs; n+=m_iNumJobThreads)
+	{
+		switch (m_eJob)
+		{
+		case JOB_BOUND:
+			Job_Bound(n);
+			break;
+		case JOB_LIGHT_TRACE:
+			Job_LightTrace(w, n);
+			break;
+		case JOB_SHADOW_CASTERS:
+			Job_ShadowCasters(w, n);
+			break;
+		case JOB_ROOM_SHADOW_CASTERS:
+			Job_RoomShadowCasters(w, n);
+			break;
+		}
+	}
+}
 
 
 int LRoomConverter::Convert_Rooms_Recursive(Node * pParent, int count, int area)
@@ -130,7 +401,18 @@ int LRoomConverter::Convert_Rooms_Recursive(Node * pParent, int count, int area)
 
 			// find or create an area with this name
 			int area_child = Area_FindOrCreate(szArea);
+			int first_room = count;
 			count = Convert_Rooms_Recursive(pChild, count, area_child);
+
+			// the rooms within the area node can be unloaded and loaded together
+			LArea &area = LMAN->m_Areas[area_child];
+			if (!area.m_iChunk_NumRooms)
+				area.m_iChunk_FirstRoom = first_room;
+
+			if ((area.m_iChunk_FirstRoom + area.m_iChunk_NumRooms) == first_room)
+				area.m_iChunk_NumRooms += count - first_room;
+			else
+				LWARN(5, "area nodes with the same name are not contiguous, only the first can be unloaded : " + szArea);
 		}
 	}
 
@@ -162,31 +444,38 @@ void LRoomConverter::Convert_Rooms()
 	int area = -1;
 
 	count = Convert_Rooms_Recursive(LROOMLIST, count, area);
+
+	// if names are repeated the first room is found, as before
+	for (int n=0; n<LMAN->m_Rooms.size(); n++)
+	{
+		const String &szName = LMAN->m_Rooms[n].m_szName;
+		if (!m_RoomNames.has(szName))
+			m_RoomNames.set(szName, n);
+	}
 }
 
 int LRoomConverter::Area_FindOrCreate(String szName)
 {
-	for (int n=0; n<LMAN->m_Areas.size(); n++)
-	{
-		if (LMAN->m_Areas[n].m_szName == szName)
-			return n;
-	}
+	const int * pID = m_AreaNames.getptr(szName);
+	if (pID)
+		return *pID;
 
 	// create
 	LArea area;
 	area.Create(szName);
 	LMAN->m_Areas.push_back(area);
-	return LMAN->m_Areas.size() - 1;
+
+	int id = LMAN->m_Areas.size() - 1;
+	m_AreaNames.set(szName, id);
+	return id;
 }
 
 
 int LRoomConverter::FindRoom_ByName(String szName) const
 {
-	for (int n=0; n<LMAN->m_Rooms.size(); n++)
-	{
-		if (LMAN->m_Rooms[n].m_szName == szName)
-			return n;
-	}
+	const int * pID = m_RoomNames.getptr(szName);
+	if (pID)
+		return *pID;
 
 	return -1;
 }
@@ -221,7 +510,7 @@ void LRoomConverter::Convert_Room_FindObjects_Recursive(Node * pParent, LRoom &l
 		Spatial * pSpatialChild = Object::cast_to<Spatial>(pChild);
 		if (pSpatialChild && (Convert_IsVisibleInRooms(pSpatialChild) == false))
 		{
-			pSpatialChild->queue_delete();
+			Node_Delete(pSpatialChild, false);
 			continue;
 		}
 
@@ -271,7 +560,7 @@ void LRoomConverter::Convert_Room_FindObjects_Recursive(Node * pParent, LRoom &l
 			LRoom_PushBackSOB(lroom, sob);
 
 			// take away layer 0 from the sob, so it can be culled effectively
-			if (m_bFinalRun)
+			if (m_bFinalRun && !m_bDeferNodeChanges)
 			{
 				pVI->set_layer_mask(0);
 			}
@@ -368,39 +657,6 @@ bool LRoomConverter::Convert_Room(Spatial * pNode, int lroomID, int areaID)
 	return true;
 }
 
-bool LRoomConverter::Bound_AddPlaneIfUnique(LVector<Plane> &planes, const Plane &p)
-{
-	for (int n=0; n<planes.size(); n++)
-	{
-		const Plane &o = planes[n];
-
-		// this is a fudge factor for how close planes can be to be considered the same ...
-		// to prevent ridiculous amounts of planes
-		const float d = 0.08f;
-
-		if (fabs(p.d - o.d) > d) continue;
-
-		float dot = p.normal.dot(o.normal);
-		if (dot < 0.98f) continue;
-
-		// match!
-		return false;
-	}
-
-	// test
-//	Vector3 va(1, 0, 0);
-//	Vector3 vb(1, 0.2, 0);
-//	vb.normalize();
-//	float dot = va.dot(vb);
-//	print("va dot vb is " + String(Variant(dot)));
-
-	// is unique
-//	print("\t\t\t\tAdding bound plane : " + p);
-
-	planes.push_back(p);
-	return true;
-}
-
 bool LRoomConverter::Convert_Bound_FromPoints(LRoom &lroom, const Vector<Vector3> &points)
 {
 	if (points.size() > 3)
@@ -409,18 +665,36 @@ bool LRoomConverter::Convert_Bound_FromPoints(LRoom &lroom, const Vector<Vector3
 		Error err = QuickHull::build(points, md);
 		if (err == OK)
 		{
+			// this is a fudge factor for how close planes can be to be considered the same ...
+			// to prevent ridiculous amounts of planes
+			LPlaneDedup dedup(0.08f, 0.98f);
+
 			// get the planes
 			for (int n=0; n<md.faces.size(); n++)
 			{
 				const Plane &p = md.faces[n].plane;
-				Bound_AddPlaneIfUnique(lroom.m_Bound.m_Planes, p);
+				if (dedup.AddIfUnique(p))
+					lroom.m_Bound.m_Planes.push_back(p);
 			}
 
-			LPRINT(2, "\t\t\tcontained " + itos(lroom.m_Bound.m_Planes.size()) + " planes.");
+			// the planes are tested on every dob update, so can optionally be capped
+			int max_planes = LMAN->m_iBoundMaxPlanes;
+			bool bSimplified = max_planes && (lroom.m_Bound.m_Planes.size() > MAX(max_planes, 6));
+			if (bSimplified)
+				Bound_Simplify(lroom, points, md, max_planes);
 
+#ifdef DEBUG_ENABLED
 			// make a copy of the mesh data for debugging
-			// note this could be avoided in release builds? NYI
-			lroom.m_Bound_MeshData = md;
+			if (bSimplified)
+			{
+				PoolVector<Plane> bound_planes;
+				for (int n=0; n<lroom.m_Bound.m_Planes.size(); n++)
+					bound_planes.push_back(lroom.m_Bound.m_Planes[n]);
+				lroom.m_Bound_MeshData = Geometry::build_convex_mesh(bound_planes);
+			}
+			else
+				lroom.m_Bound_MeshData = md;
+#endif
 
 //			for (int f=0; f<md.faces.size(); f++)
 //			{
@@ -441,6 +715,78 @@ bool LRoomConverter::Convert_Bound_FromPoints(LRoom &lroom, const Vector<Vector3
 }
 
 
+// Keeps the planes of the largest faces of the hull, then closes the bound with the planes of the
+// points AABB. Dropping planes only makes the bound larger, so it still contains the whole room.
+void LRoomConverter::Bound_Simplify(LRoom &lroom, const Vector<Vector3> &points, const Geometry::MeshData &md, int max_planes)
+{
+	LVector<Plane> &planes = lroom.m_Bound.m_Planes;
+	int num_before = planes.size();
+	max_planes = MAX(max_planes, 6);
+
+	LVector<float> areas;
+	areas.resize(md.faces.size());
+	for (int f=0; f<md.faces.size(); f++)
+	{
+		const Geometry::MeshData::Face &face = md.faces[f];
+		const Vector3 &pt0 = md.vertices[face.indices[0]];
+
+		float area = 0.0f;
+		for (int t=1; t<face.indices.size()-1; t++)
+		{
+			const Vector3 &pt1 = md.vertices[face.indices[t]];
+			const Vector3 &pt2 = md.vertices[face.indices[t+1]];
+			area += (pt1 - pt0).cross(pt2 - pt0).length() * 0.5f;
+		}
+		areas[f] = area;
+	}
+
+	planes.clear();
+	LPlaneDedup dedup(0.08f, 0.98f);
+
+	// largest faces first, leaving room for the aabb
+	while (planes.size() < (max_planes - 6))
+	{
+		int best = -1;
+		for (int f=0; f<areas.size(); f++)
+		{
+			if ((areas[f] >= 0.0f) && ((best == -1) || (areas[f] > areas[best])))
+				best = f;
+		}
+
+		if (best == -1)
+			break;
+
+		areas[best] = -1.0f;
+
+		const Plane &p = md.faces[best].plane;
+		if (dedup.AddIfUnique(p))
+			planes.push_back(p);
+	}
+
+	AABB bb;
+	bb.position = points[0];
+	for (int n=1; n<points.size(); n++)
+		bb.expand_to(points[n]);
+
+	Vector3 ptMax = bb.position + bb.size;
+	Plane bb_planes[6];
+	bb_planes[0] = Plane(Vector3(1, 0, 0), ptMax.x);
+	bb_planes[1] = Plane(Vector3(-1, 0, 0), -bb.position.x);
+	bb_planes[2] = Plane(Vector3(0, 1, 0), ptMax.y);
+	bb_planes[3] = Plane(Vector3(0, -1, 0), -bb.position.y);
+	bb_planes[4] = Plane(Vector3(0, 0, 1), ptMax.z);
+	bb_planes[5] = Plane(Vector3(0, 0, -1), -bb.position.z);
+
+	// unless a face is already there
+	for (int n=0; n<6; n++)
+	{
+		if (dedup.AddIfUnique(bb_planes[n]))
+			planes.push_back(bb_planes[n]);
+	}
+
+	LPRINT(2, "\tBOUND_SIMPLIFY room : '" + lroom.get_name() + "' " + itos(num_before) + " planes to " + itos(planes.size()));
+}
+
 void LRoomConverter::GetWorldVertsFromMesh(const MeshInstance &mi, Vector<Vector3> &pts) const
 {
 	// some godot jiggery pokery to get the mesh verts in local space
@@ -466,19 +812,16 @@ void LRoomConverter::GetWorldVertsFromMesh(const MeshInstance &mi, Vector<Vector
 	}
 }
 
-bool LRoomConverter::Convert_ManualBound(LRoom &lroom, MeshInstance * pMI)
+void LRoomConverter::Convert_ManualBound(LRoom &lroom, MeshInstance * pMI, Vector<Vector3> &points)
 {
 	LPRINT(2, "\tCONVERT_MANUAL_BOUND : '" + pMI->get_name() + "' for room '" + lroom.get_name() + "'");
 
-	Vector<Vector3> points;
 	GetWorldVertsFromMesh(*pMI, points);
 	for (int n=0; n<points.size(); n++)
 	{
 		// expand the room AABB to make sure it encompasses the bound
 		lroom.m_AABB.expand_to(points[n]);
 	}
-
-	return Convert_Bound_FromPoints(lroom, points);
 }
 
 // hide all in preparation for first frame
@@ -502,30 +845,51 @@ bool LRoomConverter::Convert_ManualBound(LRoom &lroom, MeshInstance * pMI)
 
 void LRoomConverter::Convert_AreaLights()
 {
+	int nAreas = LMAN->m_Areas.size();
+	int nLights = LMAN->m_Lights.size();
+
+	// the rooms in each area, in room order
+	LVector<LVector<int> > area_rooms;
+	area_rooms.resize(nAreas);
+
+	for (int r=0; r<LMAN->m_Rooms.size(); r++)
+	{
+		const LRoom &room = LMAN->m_Rooms[r];
+		for (int i=0; i<room.m_Areas.size(); i++)
+		{
+			LVector<int> &rooms = area_rooms[room.m_Areas[i]];
+
+			// in case the room lists the area twice
+			if (rooms.size() && (rooms[rooms.size()-1] == r))
+				continue;
+
+			rooms.push_back(r);
+		}
+	}
+
 	// list the rooms in each area
-	for (int a=0; a<LMAN->m_Areas.size(); a++)
+	for (int a=0; a<nAreas; a++)
 	{
 		LArea &area = LMAN->m_Areas[a];
+		const LVector<int> &rooms = area_rooms[a];
 
-		// add every room in this area to the light affected rooms list
-		for (int r=0; r<LMAN->m_Rooms.size(); r++)
+		for (int i=0; i<rooms.size(); i++)
 		{
-			LRoom &room = LMAN->m_Rooms[r];
-			if (room.IsInArea(a))
-			{
-				// add the room to the area room list
-				if (area.m_iNumRooms == 0)
-					area.m_iFirstRoom = LMAN->m_AreaRooms.size();
+			// add the room to the area room list
+			if (area.m_iNumRooms == 0)
+				area.m_iFirstRoom = LMAN->m_AreaRooms.size();
 
-				area.m_iNumRooms += 1;
-				LMAN->m_AreaRooms.push_back(r);
-			}
+			area.m_iNumRooms += 1;
+			LMAN->m_AreaRooms.push_back(rooms[i]);
 		}
 	}
 
 
 	// first identify which lights are area lights, and match area strings to area IDs
-	for (int n=0; n<LMAN->m_Lights.size(); n++)
+	LVector<LVector<int> > area_lights;
+	area_lights.resize(nAreas);
+
+	for (int n=0; n<nLights; n++)
 	{
 		LLight &l = LMAN->m_Lights[n];
 
@@ -536,15 +900,9 @@ void LRoomConverter::Convert_AreaLights()
 		assert (l.m_iArea == -1);
 
 		// match area string to area
-		// find the area
-		for (int n=0; n<LMAN->m_Areas.size(); n++)
-		{
-			if (LMAN->m_Areas[n].m_szName == l.m_szArea)
-			{
-				l.m_iArea = n;
-				break;
-			}
-		}
+		const int * pAreaID = m_AreaNames.getptr(l.m_szArea);
+		if (pAreaID)
+			l.m_iArea = *pAreaID;
 
 		// area not found?
 		if (l.m_iArea == -1)
@@ -554,36 +912,30 @@ void LRoomConverter::Convert_AreaLights()
 		else
 		{
 			LPRINT(5,"Area light " + itos (n) + " area " + l.m_szArea + " found area_id " + itos(l.m_iArea));
+			area_lights[l.m_iArea].push_back(n);
 		}
 	}
 
 
 	// add each light within an area to the area light list
-	for (int a=0; a<LMAN->m_Areas.size(); a++)
+	for (int a=0; a<nAreas; a++)
 	{
 		LArea &area = LMAN->m_Areas[a];
+		const LVector<int> &lights = area_lights[a];
 
-		for (int n=0; n<LMAN->m_Lights.size(); n++)
+		for (int i=0; i<lights.size(); i++)
 		{
-			LLight &l = LMAN->m_Lights[n];
-
-			int areaID = l.m_iArea;
-			if (areaID != a)
-				continue;
-
 			// this light affects this area
 			if (area.m_iNumLights == 0)
 				area.m_iFirstLight = LMAN->m_AreaLights.size();
 
-			LMAN->m_AreaLights.push_back(n);
+			LMAN->m_AreaLights.push_back(lights[i]);
 			area.m_iNumLights++;
-
-
-		} // for n
-	} // for a
+		}
+	}
 
 	// for each global light we can calculate the affected rooms
-	for (int n=0; n<LMAN->m_Lights.size(); n++)
+	for (int n=0; n<nLights; n++)
 	{
 		LLight &l = LMAN->m_Lights[n];
 
@@ -596,18 +948,16 @@ void LRoomConverter::Convert_AreaLights()
 		LPRINT(5,"Area light " + itos (n) + " affected rooms:");
 
 		// add every room in this area to the light affected rooms list
-		for (int r=0; r<LMAN->m_Rooms.size(); r++)
+		const LVector<int> &rooms = area_rooms[areaID];
+		for (int i=0; i<rooms.size(); i++)
 		{
-			LRoom &room = LMAN->m_Rooms[r];
-			if (room.IsInArea(areaID))
-			{
-				//l.AddAffectedRoom(r); // no need as this is now done by area
-				LPRINT(5,"\t" + itos (r));
+			int r = rooms[i];
 
-				// store the global lights on the room
-				room.m_GlobalLights.push_back(n);
-			}
+			//l.AddAffectedRoom(r); // no need as this is now done by area
+			LPRINT(5,"\t" + itos (r));
 
+			// store the global lights on the room
+			LMAN->m_Rooms[r].m_GlobalLights.push_back(n);
 		}
 	}
 }
@@ -615,8 +965,19 @@ void LRoomConverter::Convert_AreaLights()
 
 void LRoomConverter::Convert_Lights()
 {
-	// trace local lights out from rooms and add to each room the light affects
-	for (int n=0; n<LMAN->m_Lights.size(); n++)
+	int nLights = LMAN->m_Lights.size();
+	m_LightJobs.clear(true);
+	m_LightJobs.resize(nLights);
+	for (int n=0; n<nLights; n++)
+		m_LightJobs[n].m_bTrace = true;
+
+	Workers_Prepare();
+
+	// trace local lights out from rooms
+	Jobs_Run(JOB_LIGHT_TRACE, nLights);
+
+	// add to each room the light affects
+	for (int n=0; n<nLights; n++)
 	{
 		LLight &l = LMAN->m_Lights[n];
 		if (l.m_Source.IsGlobal())
@@ -626,6 +987,16 @@ void LRoomConverter::Convert_Lights()
 	}
 }
 
+void LRoomConverter::Job_LightTrace(LWorker &w, int iLightID)
+{
+	const LLight &l = LMAN->m_Lights[iLightID];
+	LLightJob &job = m_LightJobs[iLightID];
+	if (l.m_Source.IsGlobal() || !job.m_bTrace)
+		return;
+
+	w.m_Pool.Reset();
+	w.m_Trace.Trace_Light(*LMAN, l, LTrace::LR_CONVERT, w.m_Pool, w.m_BF_SOBs, w.m_BF_Rooms, job.m_SOBs, job.m_Rooms);
+}
 
 void LRoomConverter::Light_Trace(int iLightID)
 {
@@ -634,15 +1005,13 @@ void LRoomConverter::Light_Trace(int iLightID)
 	LPRINT(5,"_____________________________________________________________");
 	LPRINT(5,"\nLight_Trace " + itos (iLightID));
 
-	LMAN->m_Trace.Trace_Light(*LMAN, l, LTrace::LR_CONVERT);
-
 	// now save the data from the trace
-	LRoomManager::LLightRender &lr = LMAN->m_LightRender;
+	const LLightJob &lr = m_LightJobs[iLightID];
 
 	// visible rooms
-	for (int n=0; n<lr.m_Temp_Visible_Rooms.size(); n++)
+	for (int n=0; n<lr.m_Rooms.size(); n++)
 	{
-		int room_id = lr.m_Temp_Visible_Rooms[n];
+		int room_id = lr.m_Rooms[n];
 		LRoom &room = *LMAN->GetRoom(room_id);
 
 		room.AddLocalLight(iLightID);
@@ -653,9 +1022,9 @@ void LRoomConverter::Light_Trace(int iLightID)
 
 
 	// sobs
-	for (int n=0; n<lr.m_Temp_Visible_SOBs.size(); n++)
+	for (int n=0; n<lr.m_SOBs.size(); n++)
 	{
-		int sob_id = lr.m_Temp_Visible_SOBs[n];
+		int sob_id = lr.m_SOBs[n];
 
 		// first?
 		if (!l.m_NumCasters)
@@ -665,7 +1034,7 @@ void LRoomConverter::Light_Trace(int iLightID)
 		l.m_NumCasters++;
 	}
 
-	LPRINT(5, itos(lr.m_Temp_Visible_Rooms.size()) + " visible rooms, " + itos (lr.m_Temp_Visible_SOBs.size()) + " visible SOBs.\n");
+	LPRINT(5, itos(lr.m_Rooms.size()) + " visible rooms, " + itos (lr.m_SOBs.size()) + " visible SOBs.\n");
 
 /*
 	// blank this each time as it is used to create the list of casters
@@ -864,6 +1233,21 @@ void LRoomConverter::Convert_ShadowCasters()
 	int nLights = LMAN->m_Lights.size();
 	LPRINT(5,"\nConvert_ShadowCasters ... numlights " + itos (nLights));
 
+	// invert the room local light lists, so each light only visits the rooms it affects
+	for (int n=0; n<LMAN->m_Rooms.size(); n++)
+	{
+		const LRoom &lroom = LMAN->m_Rooms[n];
+		for (int i=0; i<lroom.m_LocalLights.size(); i++)
+		{
+			LVector<int> &rooms = m_LightJobs[lroom.m_LocalLights[i]].m_AffectedRooms;
+			if (rooms.size() && (rooms[rooms.size()-1] == n))
+				continue;
+
+			rooms.push_back(n);
+		}
+	}
+
+	Jobs_Run(JOB_SHADOW_CASTERS, nLights);
 
 	for (int l=0; l<nLights; l++)
 	{
@@ -876,82 +1260,151 @@ void LRoomConverter::Convert_ShadowCasters()
 
 		LPRINT(5, sz + " direction " + light.m_Source.m_ptDir);
 
-		for (int n=0; n<LMAN->m_Rooms.size(); n++)
+		const LVector<int> &casters = m_LightJobs[l].m_Casters;
+		int i = 0;
+		while (i < casters.size())
 		{
-			LRoom &lroom = LMAN->m_Rooms[n];
-
-			// global lights affect every room
-			bool bAffectsRoom = false; // true
+			LRoom &lroom = LMAN->m_Rooms[casters[i++]];
+			int nCasters = casters[i++];
 
-			// if the light is local, does it affect this room?
-			if (!light.m_Source.IsGlobal())
-			{
-				// a local light .. does it affect this room?
-				bAffectsRoom = false;
-				for (int i=0; i<lroom.m_LocalLights.size(); i++)
-				{
-					// if the light id is found among the local lights for this room
-					if (lroom.m_LocalLights[i] == l)
-					{
-						bAffectsRoom = true;
-						break;
-					}
-				}
-			}
+			LPRINT(2,"\n\tAFFECTS room " + itos(lroom.m_RoomID) + ", " + lroom.get_name());
 
-			if (bAffectsRoom)
-			{
-				LPRINT(2,"\n\tAFFECTS room " + itos(n) + ", " + lroom.get_name());
-				LRoom_FindShadowCasters_FromLight(lroom, light);
-				//LRoom_FindShadowCasters(lroom, l, light);
-			}
+			for (int c=0; c<nCasters; c++)
+				LRoom_AddShadowCaster_SOB(lroom, casters[i++]);
 		}
 	}
 }
 
-
-void LRoomConverter::Convert_Bounds()
+void LRoomConverter::Job_ShadowCasters(LWorker &w, int iLightID)
 {
-	for (int n=0; n<LMAN->m_Rooms.size(); n++)
+	const LLight &light = LMAN->m_Lights[iLightID];
+	LVector<int> &casters = m_LightJobs[iLightID].m_Casters;
+	casters.clear();
+
+	// global lights are not traced
+	if (light.m_Source.IsGlobal())
+		return;
+
+	const LVector<int> &rooms = m_LightJobs[iLightID].m_AffectedRooms;
+	for (int i=0; i<rooms.size(); i++)
 	{
-		LRoom &lroom = LMAN->m_Rooms[n];
+		int n = rooms[i];
+		const LRoom &lroom = LMAN->m_Rooms[n];
 
-		//print("DetectBounds from room " + lroom.get_name());
+		casters.push_back(n);
+		int count_pos = casters.size();
+		casters.push_back(0);
 
-		Spatial * pGRoom = lroom.GetGodotRoom();
-		assert (pGRoom);
+		LRoom_FindShadowCasters_FromLight(w, lroom, light, casters);
+		casters[count_pos] = casters.size() - count_pos - 1;
+	}
+}
 
+// all the shadow casters for a room, used when reconverting
+void LRoomConverter::Job_RoomShadowCasters(LWorker &w, int iRoomID)
+{
+	LTempRoom &troom = m_TempRooms[iRoomID];
+	if (!troom.m_bFindCasters)
+		return;
 
-		for (int n=0; n<pGRoom->get_child_count(); n++)
-		{
-			Node * pChild = pGRoom->get_child(n);
+	troom.m_Casters.clear();
 
-			if (Node_IsBound(pChild))
-			{
-				MeshInstance * pMesh = Object::cast_to<MeshInstance>(pChild);
-				assert (pMesh);
-				Convert_ManualBound(lroom, pMesh);
+	const LRoom &lroom = LMAN->m_Rooms[iRoomID];
+	for (int i=0; i<lroom.m_LocalLights.size(); i++)
+	{
+		const LLight &light = LMAN->m_Lights[lroom.m_LocalLights[i]];
+		if (light.m_Source.IsGlobal())
+			continue;
 
-				// delete the mesh
-				pGRoom->remove_child(pChild);
-				pChild->queue_delete();
-				break;
-			}
-		}
+		LRoom_FindShadowCasters_FromLight(w, lroom, light, troom.m_Casters);
+	}
+}
 
-		// if no manual bound is found, we will create one by using qhull on all the points
-		if (!lroom.m_Bound.IsActive())
-		{
-			Vector<Vector3> pts;
-			Bound_FindPoints_Recursive(pGRoom, pts);
 
-			LPRINT(2, "\tCONVERT_AUTO_BOUND room : '" + lroom.get_name() + "' (" + itos(pts.size()) + " verts)");
+void LRoomConverter::Convert_Bounds()
+{
+	int nRooms = LMAN->m_Rooms.size();
+
+	// the points were gathered from the scene in Convert_Gather
+	// the hulls are the expensive part
+	Jobs_Run(JOB_BOUND, nRooms);
+
+	for (int n=0; n<nRooms; n++)
+		Bound_Finish(n);
+}
+
+void LRoomConverter::Bound_Gather(int iRoomID)
+{
+	LRoom &lroom = LMAN->m_Rooms[iRoomID];
+	LTempRoom &troom = m_TempRooms[iRoomID];
+	troom.m_bManualBound = false;
+
+	//print("DetectBounds from room " + lroom.get_name());
+
+	Spatial * pGRoom = lroom.GetGodotRoom();
+	assert (pGRoom);
+
+
+	for (int n=0; n<pGRoom->get_child_count(); n++)
+	{
+		Node * pChild = pGRoom->get_child(n);
+
+		if (Node_IsBound(pChild))
+		{
+			MeshInstance * pMesh = Object::cast_to<MeshInstance>(pChild);
+			assert (pMesh);
+			Convert_ManualBound(lroom, pMesh, troom.m_BoundPoints);
+			troom.m_bManualBound = true;
 
-			// use qhull
-			Convert_Bound_FromPoints(lroom, pts);
+			// delete the mesh
+			Node_Delete(pChild, true);
+			break;
 		}
 	}
 
+	// the scene can't be read on the conversion thread, in case the manual bound fails
+	if (troom.m_bManualBound && m_bDeferNodeChanges)
+		Bound_FindPoints_Recursive(pGRoom, troom.m_FallbackPoints);
+
+	// if no manual bound is found, we will create one by using qhull on all the points
+	if (!troom.m_bManualBound)
+	{
+		Bound_FindPoints_Recursive(pGRoom, troom.m_BoundPoints);
+
+		LPRINT(2, "\tCONVERT_AUTO_BOUND room : '" + lroom.get_name() + "' (" + itos(troom.m_BoundPoints.size()) + " verts)");
+	}
+}
+
+void LRoomConverter::Bound_Finish(int iRoomID)
+{
+	LRoom &lroom = LMAN->m_Rooms[iRoomID];
+	LTempRoom &troom = m_TempRooms[iRoomID];
+
+	// a manual bound that failed falls back to the automatic bound
+	if (troom.m_bManualBound && !lroom.m_Bound.IsActive())
+	{
+		troom.m_BoundPoints.clear();
+		if (m_bDeferNodeChanges)
+			troom.m_BoundPoints = troom.m_FallbackPoints;
+		else
+			Bound_FindPoints_Recursive(lroom.GetGodotRoom(), troom.m_BoundPoints);
+
+		LPRINT(2, "\tCONVERT_AUTO_BOUND room : '" + lroom.get_name() + "' (" + itos(troom.m_BoundPoints.size()) + " verts)");
+		Convert_Bound_FromPoints(lroom, troom.m_BoundPoints);
+	}
+
+	if (lroom.m_Bound.IsActive())
+	{
+		LPRINT(2, "\t\t\tcontained " + itos(lroom.m_Bound.m_Planes.size()) + " planes.");
+	}
+
+	troom.m_BoundPoints.clear();
+	troom.m_FallbackPoints.clear();
+}
+
+void LRoomConverter::Job_Bound(int iRoomID)
+{
+	Convert_Bound_FromPoints(LMAN->m_Rooms[iRoomID], m_TempRooms[iRoomID].m_BoundPoints);
 }
 
 void LRoomConverter::Bound_FindPoints_Recursive(Node * pNode, Vector<Vector3> &pts)
@@ -967,13 +1420,19 @@ void LRoomConverter::Bound_FindPoints_Recursive(Node * pNode, Vector<Vector3> &p
 	for (int n=0; n<pNode->get_child_count(); n++)
 	{
 		Node * pChild = pNode->get_child(n);
+
+		// portal and bound meshes are still in the scene if their deletion is deferred
+		if (m_bDeferNodeChanges && (Node_IsPortal(pChild) || Node_IsBound(pChild)))
+			continue;
+
 		Bound_FindPoints_Recursive(pChild, pts);
 	}
 }
 
+// the portal meshes have already been detected
 void LRoomConverter::Convert_Portals()
 {
-	for (int pass=0; pass<3; pass++)
+	for (int pass=1; pass<3; pass++)
 	{
 		LPRINT(2, "Convert_Portals pass " + itos(pass));
 		LPRINT(2, "");
@@ -985,9 +1444,6 @@ void LRoomConverter::Convert_Portals()
 
 			switch (pass)
 			{
-			case 0:
-				LRoom_DetectPortalMeshes(lroom, troom);
-				break;
 			case 1:
 				LRoom_MakePortalsTwoWay(lroom, troom, n);
 				break;
@@ -1002,6 +1458,363 @@ void LRoomConverter::Convert_Portals()
 }
 
 
+// Merges small neighbouring rooms and coalesces portals, before the mirror portals are made.
+// Each room and portal is a step (and a set of planes) when tracing, so fewer is faster.
+void LRoomConverter::Optimize_Graph()
+{
+	if (!LMAN->m_bGraphOptimization || m_bSingleRoomMode)
+		return;
+
+	int nRooms = LMAN->m_Rooms.size();
+	int nPortals = 0;
+	for (int n=0; n<nRooms; n++)
+		nPortals += m_TempRooms[n].m_Portals.size();
+
+	LPRINT(5, "Optimize_Graph");
+
+	int nMerged = 0;
+	if (LMAN->m_iMergeMaxObjects)
+		nMerged = Optimize_MergeRooms();
+
+	int nPortalsAfter = 0;
+	for (int n=0; n<m_TempRooms.size(); n++)
+	{
+		Optimize_CoalescePortals(m_TempRooms[n], LMAN->m_Rooms[n].m_szName);
+		nPortalsAfter += m_TempRooms[n].m_Portals.size();
+	}
+
+	LPRINT(5, "LPortal graph optimization : " + itos(nRooms) + " rooms to " + itos(LMAN->m_Rooms.size()) + " (" + itos(nMerged) + " merges), "
+			+ itos(nPortals) + " portals to " + itos(nPortalsAfter));
+	Timing_Phase("graph");
+}
+
+// Greedy, along the portals. Rooms are merged while the merged room has few enough objects,
+// and its hull is not much bigger than the rooms, so the bound still fits it well.
+int LRoomConverter::Optimize_MergeRooms()
+{
+	int nRooms = LMAN->m_Rooms.size();
+
+	// each room starts in a group of its own, the lowest room id in a group is the room kept
+	LVector<int> groups;
+	LVector<int> group_sobs;
+	LVector<float> group_volume;
+	LVector<Vector<Vector3> > group_hull;
+	groups.resize(nRooms);
+	group_sobs.resize(nRooms);
+	group_volume.resize(nRooms);
+	group_hull.resize(nRooms);
+
+	for (int n=0; n<nRooms; n++)
+	{
+		groups[n] = n;
+		group_sobs[n] = LMAN->m_Rooms[n].m_iNumSOBs;
+		group_volume[n] = -1.0f;
+
+		if (Optimize_CanMergeRoom(n))
+			group_volume[n] = Optimize_HullVolume(m_TempRooms[n].m_BoundPoints, group_hull[n]);
+	}
+
+	int nMerged = 0;
+	for (int a=0; a<nRooms; a++)
+	{
+		const LTempRoom &troom = m_TempRooms[a];
+		for (int p=0; p<troom.m_Portals.size(); p++)
+		{
+			int b = troom.m_Portals[p].m_iRoomNum;
+			int ga = Optimize_FindGroup(groups, a);
+			int gb = Optimize_FindGroup(groups, b);
+			if (ga == gb)
+				continue;
+
+			// flat or failed hulls can't be merged
+			if ((group_volume[ga] <= 0.0001f) || (group_volume[gb] <= 0.0001f))
+				continue;
+
+			if ((group_sobs[ga] + group_sobs[gb]) > LMAN->m_iMergeMaxObjects)
+				continue;
+
+			// the hull of the hulls
+			Vector<Vector3> points = group_hull[ga];
+			points.append_array(group_hull[gb]);
+
+			Vector<Vector3> hull;
+			float volume = Optimize_HullVolume(points, hull);
+			if ((volume <= 0.0f) || (volume > ((group_volume[ga] + group_volume[gb]) * 1.1f)))
+				continue;
+
+			int keep = MIN(ga, gb);
+			int lose = MAX(ga, gb);
+			groups[lose] = keep;
+			group_sobs[keep] += group_sobs[lose];
+			group_volume[keep] = volume;
+			group_hull[keep] = hull;
+			nMerged++;
+
+			LPRINT(5, "\tmerged room " + LMAN->m_Rooms[b].m_szName + " with " + LMAN->m_Rooms[a].m_szName);
+		}
+	}
+
+	if (nMerged)
+		Optimize_CompactRooms(groups);
+
+	return nMerged;
+}
+
+bool LRoomConverter::Optimize_CanMergeRoom(int iRoomID) const
+{
+	const LRoom &lroom = LMAN->m_Rooms[iRoomID];
+
+	// rooms in areas can be unloaded together, and manual bounds are kept as they were made
+	if (lroom.m_Areas.size() || m_TempRooms[iRoomID].m_bManualBound)
+		return false;
+
+	return (lroom.m_iNumSOBs > 0) && (lroom.m_iNumSOBs <= LMAN->m_iMergeMaxObjects);
+}
+
+// The merged rooms are rebuilt in the order of the rooms kept, with their sobs contiguous.
+// The old room ids become the user room ids, so the client sees the same ids as without merging.
+void LRoomConverter::Optimize_CompactRooms(LVector<int> &groups)
+{
+	int nRooms = LMAN->m_Rooms.size();
+
+	LVector<int> remap;
+	remap.resize(nRooms);
+	int nNewRooms = 0;
+	for (int n=0; n<nRooms; n++)
+	{
+		if (Optimize_FindGroup(groups, n) == n)
+			remap[n] = nNewRooms++;
+	}
+
+	// the room kept always has a lower id, so is already remapped
+	for (int n=0; n<nRooms; n++)
+		remap[n] = remap[Optimize_FindGroup(groups, n)];
+
+	LMAN->m_UserRooms.resize(nRooms);
+	for (int n=0; n<nRooms; n++)
+	{
+		LRoomManager::LUserRoom &user = LMAN->m_UserRooms[n];
+		user.m_iRoom = remap[n];
+		user.m_GodotID = LMAN->m_Rooms[n].m_GodotID;
+		user.m_szName = LMAN->m_Rooms[n].m_szName;
+	}
+
+	LVector<LRoom> old_rooms;
+	LVector<LTempRoom> old_trooms;
+	LVector<LSob> old_sobs;
+	old_rooms.copy_from(LMAN->m_Rooms);
+	old_trooms.copy_from(m_TempRooms);
+	old_sobs.copy_from(LMAN->m_SOBs);
+
+	LMAN->m_Rooms.resize(nNewRooms);
+	m_TempRooms.resize(nNewRooms);
+	LMAN->m_SOBs.clear();
+
+	// the old rooms in each new room, in order
+	LMAN->UserRooms_Create();
+
+	for (int r=0; r<nNewRooms; r++)
+	{
+		int first = LMAN->m_RoomUsers_First[r];
+		int last = LMAN->m_RoomUsers_First[r + 1];
+
+		LRoom &lroom = LMAN->m_Rooms[r];
+		LTempRoom &troom = m_TempRooms[r];
+		lroom = old_rooms[LMAN->m_RoomUsers[first]];
+		troom = old_trooms[LMAN->m_RoomUsers[first]];
+
+		lroom.m_RoomID = r;
+		lroom.m_iFirstSOB = LMAN->m_SOBs.size();
+		lroom.m_iNumSOBs = 0;
+
+		for (int n=first; n<last; n++)
+		{
+			int old_id = LMAN->m_RoomUsers[n];
+			const LRoom &old_room = old_rooms[old_id];
+
+			for (int s=0; s<old_room.m_iNumSOBs; s++)
+				LMAN->m_SOBs.push_back(old_sobs[old_room.m_iFirstSOB + s]);
+			lroom.m_iNumSOBs += old_room.m_iNumSOBs;
+
+			if (n == first)
+				continue;
+
+			const LTempRoom &old_troom = old_trooms[old_id];
+			for (int p=0; p<old_troom.m_Portals.size(); p++)
+				troom.m_Portals.push_back(old_troom.m_Portals[p]);
+			troom.m_BoundPoints.append_array(old_troom.m_BoundPoints);
+
+			lroom.m_AABB.merge_with(old_room.m_AABB);
+			lroom.m_ptCentre = lroom.m_AABB.position + (lroom.m_AABB.size * 0.5f);
+		}
+	}
+
+	// portals within merged rooms are no longer needed
+	for (int r=0; r<nNewRooms; r++)
+	{
+		LVector<LPortal> &portals = m_TempRooms[r].m_Portals;
+
+		int nKept = 0;
+		for (int p=0; p<portals.size(); p++)
+		{
+			int link = remap[portals[p].m_iRoomNum];
+			if (link == r)
+				continue;
+
+			if (nKept != p)
+				portals[nKept] = portals[p];
+
+			portals[nKept].m_iRoomNum = link;
+			portals[nKept].m_szName = LMAN->m_Rooms[link].m_szName;
+			nKept++;
+		}
+		portals.resize(nKept);
+	}
+
+	for (int n=0; n<LMAN->m_Lights.size(); n++)
+	{
+		LSource &source = LMAN->m_Lights[n].m_Source;
+		if (source.m_RoomID != -1)
+			source.m_RoomID = remap[source.m_RoomID];
+	}
+
+	// area rooms aren't merged, so stay contiguous
+	for (int n=0; n<LMAN->m_Areas.size(); n++)
+	{
+		LArea &area = LMAN->m_Areas[n];
+		if (area.m_iChunk_NumRooms)
+			area.m_iChunk_FirstRoom = remap[area.m_iChunk_FirstRoom];
+	}
+
+	m_RoomNames.clear();
+	for (int n=0; n<nRooms; n++)
+	{
+		const String &szName = LMAN->m_UserRooms[n].m_szName;
+		if (!m_RoomNames.has(szName))
+			m_RoomNames.set(szName, remap[n]);
+	}
+}
+
+// Coplanar portals to the same room (e.g. a doorway made of several quads) are replaced by their hull,
+// if they are touching so the hull doesn't cover much more than the portals.
+int LRoomConverter::Optimize_CoalescePortals(LTempRoom &troom, const String &szRoom)
+{
+	LVector<LPortal> &portals = troom.m_Portals;
+	int nCoalesced = 0;
+
+	for (int a=0; a<portals.size(); a++)
+	{
+		for (int b=a+1; b<portals.size(); b++)
+		{
+			const LPortal &pa = portals[a];
+			const LPortal &pb = portals[b];
+			if ((pa.m_iRoomNum != pb.m_iRoomNum) || (pa.m_bMirror != pb.m_bMirror))
+				continue;
+
+			// same plane, facing the same way
+			if (pa.m_Plane.normal.dot(pb.m_Plane.normal) < 0.999f)
+				continue;
+			if (Math::abs(pa.m_Plane.distance_to(pb.m_ptCentre)) > 0.01f)
+				continue;
+
+			LPortal merged = pa;
+			merged.m_ptsWorld.append_array(pb.m_ptsWorld);
+			merged.Simplify(0);
+
+			float area = Optimize_PortalArea(pa) + Optimize_PortalArea(pb);
+			if (Optimize_PortalArea(merged) > ((area * 1.02f) + 0.0001f))
+				continue;
+
+			merged.Simplify(LMAN->m_iPortalMaxVerts);
+			LPRINT(5, "\tcoalesced portals from room " + szRoom + " to " + pa.m_szName + ", verts " + itos(pa.m_ptsWorld.size()) + " + " + itos(pb.m_ptsWorld.size()) + " to " + itos(merged.m_ptsWorld.size()));
+			portals[a] = merged;
+
+			// keep the order of the rest
+			for (int n=b+1; n<portals.size(); n++)
+				portals[n-1] = portals[n];
+			portals.resize(portals.size() - 1);
+			nCoalesced++;
+
+			// the bigger portal may now reach others
+			b = a;
+		}
+	}
+
+	return nCoalesced;
+}
+
+int LRoomConverter::Optimize_FindGroup(LVector<int> &groups, int iRoomID)
+{
+	int root = iRoomID;
+	while (groups[root] != root)
+		root = groups[root];
+
+	// shorten the path for next time
+	while (groups[iRoomID] != root)
+	{
+		int next = groups[iRoomID];
+		groups[iRoomID] = root;
+		iRoomID = next;
+	}
+
+	return root;
+}
+
+// volume of the convex hull of the points, or -1 if there is no hull
+float LRoomConverter::Optimize_HullVolume(const Vector<Vector3> &points, Vector<Vector3> &hull_points)
+{
+	hull_points.clear();
+	if (points.size() < 4)
+		return -1.0f;
+
+	Geometry::MeshData md;
+	if (QuickHull::build(points, md) != OK)
+		return -1.0f;
+
+	hull_points = md.vertices;
+	int nVerts = hull_points.size();
+	if (!nVerts)
+		return -1.0f;
+
+	Vector3 ptInside = Vector3(0, 0, 0);
+	for (int n=0; n<nVerts; n++)
+		ptInside += hull_points[n];
+	ptInside /= nVerts;
+
+	// a pyramid from the point inside to each face
+	float volume = 0.0f;
+	for (int f=0; f<md.faces.size(); f++)
+	{
+		const Geometry::MeshData::Face &face = md.faces[f];
+
+		Vector3 ptCross = Vector3(0, 0, 0);
+		const Vector3 &pt0 = hull_points[face.indices[0]];
+		for (int i=2; i<face.indices.size(); i++)
+			ptCross += (hull_points[face.indices[i-1]] - pt0).cross(hull_points[face.indices[i]] - pt0);
+
+		float area = ptCross.length() * 0.5f;
+		volume += area * Math::abs(face.plane.distance_to(ptInside)) / 3.0f;
+	}
+
+	return volume;
+}
+
+// the portals are convex
+float LRoomConverter::Optimize_PortalArea(const LPortal &port)
+{
+	int nPoints = port.m_ptsWorld.size();
+	if (nPoints < 3)
+		return 0.0f;
+
+	Vector3 ptCross = Vector3(0, 0, 0);
+	const Vector3 &pt0 = port.m_ptsWorld[0];
+	for (int n=2; n<nPoints; n++)
+		ptCross += (port.m_ptsWorld[n-1] - pt0).cross(port.m_ptsWorld[n] - pt0);
+
+	return ptCross.length() * 0.5f;
+}
+
+
 int LRoomConverter::CountRooms()
 {
 	if (m_bSingleRoomMode)
@@ -1091,12 +1904,6 @@ void LRoomConverter::Light_AddCaster_SOB(LLight &light, int sobID)
 
 void LRoomConverter::LRoom_AddShadowCaster_SOB(LRoom &lroom, int sobID)
 {
-	// we will reuse the rendering bitflags for shadow casters for this ... to check for double entries (fnaa fnaa)
-	if (LMAN->m_BF_caster_SOBs.GetBit(sobID))
-		return;
-
-	LMAN->m_BF_caster_SOBs.SetBit(sobID, true);
-
 	// first?
 	if (!lroom.m_iNumShadowCasters_SOB)
 		lroom.m_iFirstShadowCaster_SOB = LMAN->m_ShadowCasters_SOB.size();
@@ -1106,10 +1913,10 @@ void LRoomConverter::LRoom_AddShadowCaster_SOB(LRoom &lroom, int sobID)
 }
 
 
-void LRoomConverter::LRoom_FindShadowCasters_FromLight(LRoom &lroom, const LLight &light)
+void LRoomConverter::LRoom_FindShadowCasters_FromLight(LWorker &w, const LRoom &lroom, const LLight &light, LVector<int> &casters)
 {
-	// blank this each time as it is used to create the list of casters
-	LMAN->m_BF_caster_SOBs.Blank();
+	// blank this each time as it is used to check for double entries in the list of casters
+	w.m_BF_SOBs.Blank();
 
 	// first add all objects in this room as casters
 //	int last_sob = lroom.m_iFirstSOB + lroom.m_iNumSOBs;
@@ -1126,23 +1933,24 @@ void LRoomConverter::LRoom_FindShadowCasters_FromLight(LRoom &lroom, const LLigh
 //	light.m_ptDir.normalize();
 
 	// reset the planes pool for each render out from the source room
-	LMAN->m_Pool.Reset();
+	w.m_Pool.Reset();
 
 
 	// the first set of planes are blank
-	unsigned int pool_member = LMAN->m_Pool.Request();
+	unsigned int pool_member = w.m_Pool.Request();
 	assert (pool_member != (unsigned int) -1);
 
-	LVector<Plane> &planes = LMAN->m_Pool.Get(pool_member);
+	LVector<Plane> &planes = w.m_Pool.Get(pool_member);
 	planes.clear();
 
-	Lawn::LDebug::m_iTabDepth = 0;
-	LRoom_FindShadowCasters_Recursive(lroom, 1, lroom, light, planes);
+	if (m_Workers.size() == 1)
+		Lawn::LDebug::m_iTabDepth = 0;
+	LRoom_FindShadowCasters_Recursive(w, 1, lroom, light, planes, casters);
 
 }
 
 
-void LRoomConverter::LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int depth, LRoom &lroom, const LLight &light, const LVector<Plane> &planes)
+void LRoomConverter::LRoom_FindShadowCasters_Recursive(LWorker &w, int depth, const LRoom &lroom, const LLight &light, const LVector<Plane> &planes, LVector<int> &casters)
 {
 	// prevent too much depth
 	if (depth > 8)
@@ -1152,7 +1960,8 @@ void LRoomConverter::LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int
 		return;
 	}
 
-	Lawn::LDebug::m_iTabDepth = depth;
+	if (m_Workers.size() == 1)
+		Lawn::LDebug::m_iTabDepth = depth;
 	LPRINT_RUN(2, "ROOM " + lroom.get_name());
 
 
@@ -1160,7 +1969,7 @@ void LRoomConverter::LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int
 	int last_sob = lroom.m_iFirstSOB + lroom.m_iNumSOBs;
 	for (int n=lroom.m_iFirstSOB; n<last_sob; n++)
 	{
-		LSob &sob = LMAN->m_SOBs[n];
+		const LSob &sob = LMAN->m_SOBs[n];
 
 		// not a shadow caster? don't add to the list
 		if (!sob.IsShadowCaster())
@@ -1195,7 +2004,13 @@ void LRoomConverter::LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int
 		if (bShow)
 		{
 			LPRINT_RUN(2, "\tcaster " + itos(n) + ", " + sob.GetSpatial()->get_name());
-			LRoom_AddShadowCaster_SOB(source_lroom, n);
+
+			// may be reached through more than one portal
+			if (!w.m_BF_SOBs.GetBit(n))
+			{
+				w.m_BF_SOBs.SetBit(n, true);
+				casters.push_back(n);
+			}
 		}
 		else
 		{
@@ -1265,15 +2080,15 @@ void LRoomConverter::LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int
 		}
 
 
-		LRoom &linked_room = LMAN->Portal_GetLinkedRoom(port);
+		const LRoom &linked_room = LMAN->Portal_GetLinkedRoom(port);
 
 
 		// recurse into that portal
-		unsigned int uiPoolMem = LMAN->m_Pool.Request();
+		unsigned int uiPoolMem = w.m_Pool.Request();
 		if (uiPoolMem != (unsigned int) -1)
 		{
 			// get a vector of planes from the pool
-			LVector<Plane> &new_planes = LMAN->m_Pool.Get(uiPoolMem);
+			LVector<Plane> &new_planes = w.m_Pool.Get(uiPoolMem);
 
 			// copy the existing planes
 			new_planes.copy_from(planes);
@@ -1281,12 +2096,13 @@ void LRoomConverter::LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int
 			// add the planes for the portal
 			port.AddLightPlanes(*LMAN, light, new_planes, true);
 
-			LRoom_FindShadowCasters_Recursive(source_lroom, depth + 1, linked_room, light, new_planes);
+			LRoom_FindShadowCasters_Recursive(w, depth + 1, linked_room, light, new_planes, casters);
 			// for debugging need to reset tab depth
-			Lawn::LDebug::m_iTabDepth = depth;
+			if (m_Workers.size() == 1)
+				Lawn::LDebug::m_iTabDepth = depth;
 
 			// we no longer need these planes
-			LMAN->m_Pool.Free(uiPoolMem);
+			w.m_Pool.Free(uiPoolMem);
 		}
 		else
 		{
@@ -1334,31 +2150,19 @@ void LRoomConverter::LRoom_DetectPortalMeshes(LRoom &lroom, LTempRoom &troom)
 	if (m_bFinalRun)
 //	if (true)
 	{
-		// we need an enclosing while loop because we might be deleting children and mucking up the iterator
-		bool bDetectedOne = true;
-
-		while (bDetectedOne)
+		// backwards, as we might be deleting children and mucking up the iterator
+		// (when the deletion is deferred the children stay where they are)
+		for (int n=pGRoom->get_child_count()-1; n>=0; n--)
 		{
-			bDetectedOne = false;
+			Node * pChild = pGRoom->get_child(n);
 
-			for (int n=0; n<pGRoom->get_child_count(); n++)
+			if (Node_IsPortal(pChild))
 			{
-				Node * pChild = pGRoom->get_child(n);
-
-				if (Node_IsPortal(pChild))
-				{
-					// delete the original child, as it is no longer needed at runtime (except maybe for debugging .. NYI?)
-					//	pMeshInstance->hide();
-					pChild->get_parent()->remove_child(pChild);
-					pChild->queue_delete();
-					bDetectedOne = true;
-				}
-
-				if (bDetectedOne)
-					break;
-			} // for loop
-
-		} // while
+				// delete the original child, as it is no longer needed at runtime (except maybe for debugging .. NYI?)
+				//	pMeshInstance->hide();
+				Node_Delete(pChild, true);
+			}
+		} // for loop
 	} // if we want to delete portal meshes
 
 }
@@ -1400,6 +2204,9 @@ void LRoomConverter::LRoom_MakePortalFinalList(LRoom &lroom, LTempRoom &troom)
 
 void LRoomConverter::LRoom_DetectedArea(LRoom &lroom, Node * pNode)
 {
+	if (m_bReconvert)
+		return;
+
 	// find the area name
 	String szArea = LPortal::FindNameAfter(pNode, "area_");
 
@@ -1422,16 +2229,20 @@ void LRoomConverter::LRoom_DetectedLight(LRoom &lroom, Node * pNode)
 	Light * pLight = Object::cast_to<Light>(pNode);
 	assert (pLight);
 
+	// the room lights are already registered
+	if (m_bReconvert)
+		return;
+
 	if (m_bDeleteLights)
 	{
 		LPRINT(2, "Deleting Light : " + pLight->get_name());
 		// delete light now we are using lightmaps for test
-		pLight->queue_delete();
+		Node_Delete(pLight, false);
 	}
 	else
 	{
 		LPRINT(2, "Detected Light : " + pLight->get_name());
-		LMAN->LightCreate(pLight, lroom.m_RoomID);
+		LMAN->LightCreate(pLight, lroom.m_RoomID, "", !m_bDeferNodeChanges);
 	}
 }
 
@@ -1463,6 +2274,10 @@ void LRoomConverter::LRoom_DetectedPortalMesh(LRoom &lroom, LTempRoom &troom, Me
 	// create the portal geometry
 	lport.CreateGeometry(p_vertices, pMeshInstance->get_global_transform(), LMAN->m_bPortalPlane_Convention);
 
+	// fewer verts means fewer planes to cull with through the portal
+	int nVerts = lport.Simplify(LMAN->m_iPortalMaxVerts);
+	LPRINT(5, "\tportal to " + szLinkRoom + " verts " + itos(nVerts) + ", simplified " + itos(lport.m_ptsWorld.size()));
+
 
 //	LPRINT(2, "\t\t\tnum portals now " + itos(troom.m_Portals.size()));
 }
@@ -1532,6 +2347,561 @@ void LRoomConverter::TRoom_MakeOppositePortal(const LPortal &port, int iRoomOrig
 ///////////////////////////////////////////////////
 
 // helper
+bool LRoomConverter::Reload_Area(LRoomManager &manager, int areaID, Node * pAreaNode)
+{
+	LMAN = &manager;
+	LROOMLIST = manager.GetRoomList();
+	m_bFinalRun = true;
+
+	const LArea &area = LMAN->m_Areas[areaID];
+
+	bool bOK = true;
+	int last_room = area.m_iChunk_FirstRoom + area.m_iChunk_NumRooms;
+	for (int r=area.m_iChunk_FirstRoom; r<last_room; r++)
+	{
+		LRoom &lroom = LMAN->m_Rooms[r];
+		if (lroom.m_bLoaded)
+			continue;
+
+		Spatial * pGRoom = Reload_FindRoom(pAreaNode, lroom.m_szName);
+		if (!pGRoom)
+		{
+			LWARN(5, "Reload_Area room not found : " + lroom.m_szName);
+			bOK = false;
+			continue;
+		}
+
+		if (!Reload_Room(lroom, pGRoom))
+			bOK = false;
+	}
+
+	return bOK;
+}
+
+Spatial * LRoomConverter::Reload_FindRoom(Node * pParent, const String &szName) const
+{
+	for (int n=0; n<pParent->get_child_count(); n++)
+	{
+		Node * pChild = pParent->get_child(n);
+
+		if (Node_IsRoom(pChild))
+		{
+			if (LPortal::FindNameAfter(pChild, "room_") == szName)
+				return Object::cast_to<Spatial>(pChild);
+		}
+		else if (Node_IsArea(pChild))
+		{
+			Spatial * pRoom = Reload_FindRoom(pChild, szName);
+			if (pRoom)
+				return pRoom;
+		}
+	}
+
+	return 0;
+}
+
+// the SOBs are matched to the new nodes by the order they are found, so the room must be unchanged
+bool LRoomConverter::Reload_Room(LRoom &lroom, Spatial * pGRoom)
+{
+	m_Reload_VIs.clear();
+	m_Reload_Lights.clear();
+	Reload_FindObjects_Recursive(pGRoom);
+
+	if (m_Reload_VIs.size() != lroom.m_iNumSOBs)
+	{
+		LWARN(5, "Reload_Room objects do not match the converted room : " + lroom.m_szName);
+		return false;
+	}
+
+	for (int n=0; n<m_Reload_VIs.size(); n++)
+	{
+		VisualInstance * pVI = m_Reload_VIs[n];
+
+		LSob &sob = LMAN->m_SOBs[lroom.m_iFirstSOB + n];
+		sob.m_ID = pVI->get_instance_id();
+		sob.Hidable_Create(pVI);
+		pVI->set_layer_mask(0);
+	}
+
+	// the room lights are in the order they were found on conversion
+	int l = 0;
+	for (int n=0; n<LMAN->m_Lights.size(); n++)
+	{
+		LLight &light = LMAN->m_Lights[n];
+		if (light.m_pNode || light.m_Source.IsGlobal() || (light.m_Source.m_RoomID != lroom.m_RoomID))
+			continue;
+
+		if (l == m_Reload_Lights.size())
+			break;
+
+		Light * pLight = m_Reload_Lights[l++];
+
+		// the new node starts with the default cull mask and its own shadow setting
+		LMAN->m_LightBudget.Light_Release(*LMAN, n);
+		LMAN->m_LightLayers.Light_Reset(n);
+
+		pLight->set_cull_mask(1 | LRoom::LAYER_MASK_LIGHT);
+		light.Hidable_Create(pLight);
+		light.m_GodotID = pLight->get_instance_id();
+	}
+
+	// any others were deleted on conversion
+	for (; l<m_Reload_Lights.size(); l++)
+		m_Reload_Lights[l]->queue_delete();
+
+	// portal and bound meshes are no longer needed
+	for (int n=pGRoom->get_child_count()-1; n>=0; n--)
+	{
+		Node * pChild = pGRoom->get_child(n);
+		if (Node_IsPortal(pChild) || Node_IsBound(pChild))
+			Node_Delete(pChild, true);
+	}
+
+	lroom.m_GodotID = pGRoom->get_instance_id();
+	lroom.m_bLoaded = true;
+	return true;
+}
+
+// must find objects in the same order as Convert_Room_FindObjects_Recursive
+void LRoomConverter::Reload_FindObjects_Recursive(Node * pParent)
+{
+	int nChildren = pParent->get_child_count();
+	for (int n=0; n<nChildren; n++)
+	{
+		Node * pChild = pParent->get_child(n);
+
+		Spatial * pSpatialChild = Object::cast_to<Spatial>(pChild);
+		if (pSpatialChild && (Convert_IsVisibleInRooms(pSpatialChild) == false))
+		{
+			pSpatialChild->queue_delete();
+			continue;
+		}
+
+		if (Node_IsPortal(pChild) || Node_IsIgnore(pChild) || Node_IsBound(pChild) || Node_IsArea(pChild))
+			continue;
+
+		if (Node_IsLight(pChild))
+		{
+			m_Reload_Lights.push_back(Object::cast_to<Light>(pChild));
+			continue;
+		}
+
+		VisualInstance * pVI = Object::cast_to<VisualInstance>(pChild);
+		if (pVI)
+			m_Reload_VIs.push_back(pVI);
+
+		Reload_FindObjects_Recursive(pChild);
+	}
+}
+
+///////////////////////////////////////////////////
+
+// The room is converted again in place. Rooms are referred to by index everywhere, so the other rooms
+// are untouched, and only the data that can depend on the edited room is recalculated.
+bool LRoomConverter::Reconvert_Room(LRoomManager &manager, int roomID, Spatial * pGRoom)
+{
+	LMAN = &manager;
+	LROOMLIST = manager.GetRoomList();
+	m_bFinalRun = true;
+	m_bDeleteLights = false;
+	m_bSingleRoomMode = false;
+	m_bReconvert = true;
+
+	int nRooms = LMAN->m_Rooms.size();
+
+	// name lookups for the portal links
+	m_RoomNames.clear();
+	for (int n=0; n<nRooms; n++)
+	{
+		const String &szName = LMAN->m_Rooms[n].m_szName;
+		if (!m_RoomNames.has(szName))
+			m_RoomNames.set(szName, n);
+	}
+
+	// and the rooms merged into others
+	for (int n=0; n<LMAN->m_UserRooms.size(); n++)
+	{
+		const String &szName = LMAN->m_UserRooms[n].m_szName;
+		if (!m_RoomNames.has(szName))
+			m_RoomNames.set(szName, LMAN->m_UserRooms[n].m_iRoom);
+	}
+
+	m_TempRooms.clear(true);
+	m_TempRooms.resize(nRooms);
+	for (int n=0; n<nRooms; n++)
+		m_TempRooms[n].m_bFindCasters = false;
+
+	Workers_Create(false);
+	Timing_Begin();
+
+	LRoom &lroom = LMAN->m_Rooms[roomID];
+	LPRINT(5, "Reconvert_Room : " + lroom.get_name());
+
+	// lights reaching the room through its old and new portals may have changed
+	LVector<int> rooms;
+	rooms.push_back(roomID);
+	Reconvert_FindNeighbours(lroom, rooms);
+
+	lroom.m_GodotID = pGRoom->get_instance_id();
+
+	Reconvert_RoomSOBs(lroom, pGRoom);
+	Timing_Phase("objects");
+
+	Reconvert_Portals(lroom, pGRoom);
+	Reconvert_FindNeighbours(lroom, rooms);
+	Timing_Phase("portals");
+
+	lroom.m_Bound.m_Planes.clear();
+#ifdef DEBUG_ENABLED
+	lroom.m_Bound_MeshData = Geometry::MeshData();
+#endif
+	Bound_Gather(roomID);
+	Job_Bound(roomID);
+	Bound_Finish(roomID);
+	Timing_Phase("bound");
+
+	CreateRuntimeData(manager);
+
+	Reconvert_Lights(rooms);
+	Timing_Phase("lights");
+	Reconvert_ShadowCasters(roomID);
+	Timing_Phase("shadow casters");
+
+	LPRINT(5, "LPortal reconverted room " + lroom.get_name() + " with " + itos(lroom.m_iNumSOBs) + " objects in "
+			+ itos((OS::get_singleton()->get_ticks_usec() - m_uiTimingStart) / 1000) + " ms (" + m_szTimings + ")");
+
+	m_TempRooms.clear(true);
+	m_LightJobs.clear(true);
+	Workers_Destroy();
+
+	m_bReconvert = false;
+	return true;
+}
+
+// adds the rooms linked by portals to the list, if not already present
+void LRoomConverter::Reconvert_FindNeighbours(const LRoom &lroom, LVector<int> &neighbours) const
+{
+	for (int n=0; n<lroom.m_iNumPortals; n++)
+	{
+		int room_id = LMAN->m_Portals[lroom.m_iFirstPortal + n].m_iRoomNum;
+
+		bool bFound = false;
+		for (int i=0; i<neighbours.size(); i++)
+		{
+			if (neighbours[i] == room_id)
+			{
+				bFound = true;
+				break;
+			}
+		}
+
+		if (!bFound)
+			neighbours.push_back(room_id);
+	}
+}
+
+// The objects are found again and replace the old range of sobs, moving the sobs of the later rooms
+// if the number has changed, so the sob list stays the same as after a full conversion.
+void LRoomConverter::Reconvert_RoomSOBs(LRoom &lroom, Spatial * pGRoom)
+{
+	int old_first = lroom.m_iFirstSOB;
+	int old_num = lroom.m_iNumSOBs;
+	int old_size = LMAN->m_SOBs.size();
+
+	for (int n=old_first; n<old_first+old_num; n++)
+	{
+		LSob &sob = LMAN->m_SOBs[n];
+		sob.Hidable_Release();
+		sob.m_ID = 0;
+	}
+
+	lroom.m_iFirstSOB = 0;
+	lroom.m_iNumSOBs = 0;
+
+	LAABB bb_room;
+	bb_room.SetToMaxOpposite();
+
+	Convert_Room_SetDefaultCullMask_Recursive(pGRoom);
+	Convert_Room_FindObjects_Recursive(pGRoom, lroom, bb_room);
+
+	lroom.m_ptCentre = bb_room.FindCentre();
+	lroom.m_AABB.position = bb_room.m_ptMins;
+	lroom.m_AABB.size = bb_room.m_ptMaxs - bb_room.m_ptMins;
+
+	int num = lroom.m_iNumSOBs;
+	int old_last = old_first + old_num;
+	int delta = num - old_num;
+
+	// the new sobs were added on the end
+	LVector<LSob> new_sobs;
+	new_sobs.resize(num);
+	for (int n=0; n<num; n++)
+		new_sobs[n] = LMAN->m_SOBs[old_size + n];
+
+	LVector<LSob> &sobs = LMAN->m_SOBs;
+	if (delta > 0)
+	{
+		sobs.resize(old_size + delta);
+		for (int n=old_size-1; n>=old_last; n--)
+			sobs[n + delta] = sobs[n];
+	}
+	else
+	{
+		for (int n=old_last; n<old_size; n++)
+			sobs[n + delta] = sobs[n];
+		sobs.resize(old_size + delta);
+	}
+
+	for (int n=0; n<num; n++)
+		sobs[old_first + n] = new_sobs[n];
+
+	lroom.m_iFirstSOB = old_first;
+
+	if (delta)
+	{
+		for (int n=0; n<LMAN->m_Rooms.size(); n++)
+		{
+			LRoom &room = LMAN->m_Rooms[n];
+			if ((n != lroom.m_RoomID) && (room.m_iFirstSOB >= old_last))
+				room.m_iFirstSOB += delta;
+		}
+	}
+
+	// Rooms that had the old objects as casters find them again, the other caster ids are moved.
+	// The lights with the old objects as casters reach the room, so are always retraced.
+	for (int n=0; n<LMAN->m_Rooms.size(); n++)
+	{
+		const LRoom &room = LMAN->m_Rooms[n];
+		for (int c=0; c<room.m_iNumShadowCasters_SOB; c++)
+		{
+			uint32_t &sob_id = LMAN->m_ShadowCasters_SOB[room.m_iFirstShadowCaster_SOB + c];
+			if ((int) sob_id >= old_last)
+				sob_id += delta;
+			else if ((int) sob_id >= old_first)
+				m_TempRooms[n].m_bFindCasters = true;
+		}
+	}
+
+	for (int n=0; n<LMAN->m_LightCasters_SOB.size(); n++)
+	{
+		uint32_t &sob_id = LMAN->m_LightCasters_SOB[n];
+		if ((int) sob_id >= old_last)
+			sob_id += delta;
+	}
+
+	LPRINT(5, "\t" + itos(old_num) + " objects before, " + itos(num) + " after");
+}
+
+// The original portals of the other rooms are kept, and the mirror portals made again.
+// The room's own portals are only replaced if it has portal meshes.
+void LRoomConverter::Reconvert_Portals(LRoom &lroom, Spatial * pGRoom)
+{
+	int nRooms = LMAN->m_Rooms.size();
+
+	bool bDetect = false;
+	for (int n=0; n<pGRoom->get_child_count(); n++)
+	{
+		if (Node_IsPortal(pGRoom->get_child(n)))
+		{
+			bDetect = true;
+			break;
+		}
+	}
+
+	for (int n=0; n<nRooms; n++)
+	{
+		const LRoom &room = LMAN->m_Rooms[n];
+		LTempRoom &troom = m_TempRooms[n];
+		troom.m_Portals.clear(true);
+
+		if (bDetect && (n == lroom.m_RoomID))
+			continue;
+
+		for (int p=0; p<room.m_iNumPortals; p++)
+		{
+			const LPortal &port = LMAN->m_Portals[room.m_iFirstPortal + p];
+			if (!port.m_bMirror)
+				troom.m_Portals.push_back(port);
+		}
+	}
+
+	if (bDetect)
+	{
+		LRoom_DetectPortalMeshes(lroom, m_TempRooms[lroom.m_RoomID]);
+		if (LMAN->m_bGraphOptimization)
+			Optimize_CoalescePortals(m_TempRooms[lroom.m_RoomID], lroom.m_szName);
+	}
+
+	// make the final list from scratch
+	LMAN->m_Portals.clear(true);
+	for (int n=0; n<nRooms; n++)
+	{
+		LRoom &room = LMAN->m_Rooms[n];
+		room.m_iFirstPortal = 0;
+		room.m_iNumPortals = 0;
+	}
+
+	for (int n=0; n<nRooms; n++)
+		LRoom_MakePortalsTwoWay(LMAN->m_Rooms[n], m_TempRooms[n], n);
+
+	for (int n=0; n<nRooms; n++)
+		LRoom_MakePortalFinalList(LMAN->m_Rooms[n], m_TempRooms[n]);
+}
+
+// Only lights that reach the rooms are retraced, the light caster list is rebuilt keeping the others
+void LRoomConverter::Reconvert_Lights(const LVector<int> &rooms)
+{
+	int nLights = LMAN->m_Lights.size();
+	int nRooms = LMAN->m_Rooms.size();
+
+	m_LightJobs.clear(true);
+	m_LightJobs.resize(nLights);
+
+	for (int n=0; n<nLights; n++)
+	{
+		const LLight &light = LMAN->m_Lights[n];
+		if (light.m_Source.IsGlobal())
+			continue;
+
+		// lights in the rooms
+		for (int i=0; i<rooms.size(); i++)
+		{
+			if (light.m_Source.m_RoomID == rooms[i])
+				m_LightJobs[n].m_bTrace = true;
+		}
+	}
+
+	// lights reaching the rooms
+	for (int i=0; i<rooms.size(); i++)
+	{
+		const LRoom &room = LMAN->m_Rooms[rooms[i]];
+		for (int l=0; l<room.m_LocalLights.size(); l++)
+		{
+			int light_id = room.m_LocalLights[l];
+			if (!LMAN->m_Lights[light_id].m_Source.IsGlobal())
+				m_LightJobs[light_id].m_bTrace = true;
+		}
+	}
+
+	// remove the old results from the rooms, keeping the order of the others
+	for (int n=0; n<nRooms; n++)
+	{
+		LVector<int> &lights = LMAN->m_Rooms[n].m_LocalLights;
+
+		int num_kept = 0;
+		for (int l=0; l<lights.size(); l++)
+		{
+			if (m_LightJobs[lights[l]].m_bTrace)
+				m_TempRooms[n].m_bFindCasters = true;
+			else
+				lights[num_kept++] = lights[l];
+		}
+
+		lights.resize(num_kept);
+	}
+
+	int num_traced = 0;
+	for (int n=0; n<nLights; n++)
+	{
+		if (!m_LightJobs[n].m_bTrace)
+			continue;
+
+		LLight &light = LMAN->m_Lights[n];
+		light.ClearAffectedRooms();
+		light.m_NumCasters = 0;
+		num_traced++;
+	}
+
+	Workers_Prepare();
+	Jobs_Run(JOB_LIGHT_TRACE, nLights);
+
+	LVector<uint32_t> old_casters;
+	old_casters.copy_from(LMAN->m_LightCasters_SOB);
+	LMAN->m_LightCasters_SOB.clear();
+
+	for (int n=0; n<nLights; n++)
+	{
+		LLight &light = LMAN->m_Lights[n];
+
+		if (m_LightJobs[n].m_bTrace)
+		{
+			Light_Trace(n);
+
+			// the rooms now lit need their shadow casters
+			const LVector<int> &lit = m_LightJobs[n].m_Rooms;
+			for (int i=0; i<lit.size(); i++)
+				m_TempRooms[lit[i]].m_bFindCasters = true;
+
+			continue;
+		}
+
+		int first = light.m_FirstCaster;
+		light.m_FirstCaster = LMAN->m_LightCasters_SOB.size();
+		for (int c=0; c<light.m_NumCasters; c++)
+			LMAN->m_LightCasters_SOB.push_back(old_casters[first + c]);
+	}
+
+	LPRINT(5, "Reconvert_Lights retraced " + itos(num_traced) + " lights");
+}
+
+// The shadow casters are found again for rooms whose lights changed, and rooms that had the old objects
+// of the edited room as casters (marked in Reconvert_RoomSOBs). The caster list is rebuilt keeping the others.
+void LRoomConverter::Reconvert_ShadowCasters(int iRoomID)
+{
+	int nRooms = LMAN->m_Rooms.size();
+
+	m_TempRooms[iRoomID].m_bFindCasters = true;
+
+	Jobs_Run(JOB_ROOM_SHADOW_CASTERS, nRooms);
+
+	LVector<uint32_t> old_casters;
+	old_casters.copy_from(LMAN->m_ShadowCasters_SOB);
+	LMAN->m_ShadowCasters_SOB.clear();
+
+	for (int n=0; n<nRooms; n++)
+	{
+		LRoom &room = LMAN->m_Rooms[n];
+		const LTempRoom &troom = m_TempRooms[n];
+
+		int first = room.m_iFirstShadowCaster_SOB;
+		int num = room.m_iNumShadowCasters_SOB;
+		room.m_iNumShadowCasters_SOB = 0;
+
+		if (troom.m_bFindCasters)
+		{
+			for (int c=0; c<troom.m_Casters.size(); c++)
+				LRoom_AddShadowCaster_SOB(room, troom.m_Casters[c]);
+		}
+		else
+		{
+			for (int c=0; c<num; c++)
+				LRoom_AddShadowCaster_SOB(room, old_casters[first + c]);
+		}
+	}
+}
+
+// the deleted nodes are recorded so the deletion can be repeated when loading from a conversion cache
+void LRoomConverter::Node_Delete(Node * pNode, bool bDetach)
+{
+	ObjectID id = pNode->get_instance_id();
+
+	// only portal and bound meshes can be found twice (if they are also hidden)
+	if (!bDetach || (m_DeletedNodes.find(id) == -1))
+		m_DeletedNodes.push_back(id);
+
+	if (m_bDeferNodeChanges)
+	{
+		if (bDetach)
+			m_DetachedNodes.push_back(id);
+		return;
+	}
+
+	if (bDetach)
+		pNode->get_parent()->remove_child(pNode);
+
+	pNode->queue_delete();
+}
+
 bool LRoomConverter::Node_IsLight(Node * pNode) const
 {
 	Light * pLight = Object::cast_to<Light>(pNode);
@@ -28,11 +28,19 @@
 #include "scene/3d/spatial.h"
 #include "lvector.h"
 #include "lportal.h"
+#include "ltrace.h"
+#include "lplanes_pool.h"
+#include "lbitfield_dynamic.h"
+#include "core/hash_map.h"
+#include <atomic>
 
 class LRoomManager;
 class LRoom;
 class LArea;
 class MeshInstance;
+class VisualInstance;
+class Light;
+class Thread;
 
 // simple min max aabb
 class LAABB
@@ -79,16 +87,107 @@ public:
 	{
 	public:
 		LVector<LPortal> m_Portals;
+
+		// world space points gathered from the scene for the room bound
+		Vector<Vector3> m_BoundPoints;
+		bool m_bManualBound;
+
+		// the automatic bound points, if a manual bound fails during async conversion
+		Vector<Vector3> m_FallbackPoints;
+
+		// shadow casters from all the local lights, when reconverting
+		bool m_bFindCasters;
+		LVector<int> m_Casters;
+	};
+
+	// Conversion is split into gathering from the scene tree, which is done on the main thread,
+	// and computing, which is independent per room or per light and is spread over worker threads.
+	// Each worker has its own trace state so the workers only read the shared converted data.
+	class LWorker
+	{
+	public:
+		LWorker() {m_iID = 0; m_pConverter = 0; m_pThread = 0;}
+
+		int m_iID;
+		LRoomConverter * m_pConverter;
+		Thread * m_pThread;
+
+		LTrace m_Trace;
+		LPlanesPool m_Pool;
+		Lawn::LBitField_Dynamic m_BF_SOBs;
+		Lawn::LBitField_Dynamic m_BF_Rooms;
+	};
+
+	// results for each light from the workers, merged in light order afterwards
+	// so the output is the same whatever the number of threads
+	class LLightJob
+	{
+	public:
+		LLightJob() {m_bTrace = false;}
+
+		// only some lights are retraced when reconverting a room
+		bool m_bTrace;
+
+		LVector<int> m_Rooms;
+		LVector<int> m_SOBs;
+
+		// rooms with the light in their local lights, in room order
+		LVector<int> m_AffectedRooms;
+
+		// shadow casters for each affected room, stored as room id, number of casters, then the sob ids
+		LVector<int> m_Casters;
 	};
 
+	LRoomConverter();
+	~LRoomConverter();
+
 	// this function calls everything else in the converter
 	// single room mode enables us to emulate a room list in games that do not have rooms...
 	// this allows taking advantage of basic LPortal speedup without converting games / demos
 	void Convert(LRoomManager &manager, bool bVerbose, bool bPreparationRun, bool bDeleteLights, bool bSingleRoomMode = false);
 
+	// Convert in the background. Async_Begin reads the scene, then the rest is done on a thread.
+	// When Async_IsDone, Async_End must be called on the main thread to make the changes to the scene.
+	enum {ASYNC_NUM_STEPS = 6};
+	void Async_Begin(LRoomManager &manager, bool bVerbose, bool bDeleteLights, bool bSingleRoomMode = false);
+	bool Async_IsDone() const {return m_bAsyncDone.load();}
+	float Async_GetProgress() const {return m_iAsyncStep.load() / (float) ASYNC_NUM_STEPS;}
+	void Async_End();
+
+	// bitfields and lookups sized for the converted rooms, sobs and lights
+	// (also used when the converted data is loaded from a cache)
+	void CreateRuntimeData(LRoomManager &manager);
+
+	// the nodes deleted during conversion
+	const LVector<ObjectID> &GetDeletedNodes() const {return m_DeletedNodes;}
+
+	// find the godot nodes for the rooms of an unloaded area, from a new instance of the area node
+	bool Reload_Area(LRoomManager &manager, int areaID, Node * pAreaNode);
+
+	// convert a single room again after it has been edited, patching the converted data
+	bool Reconvert_Room(LRoomManager &manager, int roomID, Spatial * pGRoom);
+
 private:
+	enum eJob
+	{
+		JOB_BOUND,
+		JOB_LIGHT_TRACE,
+		JOB_SHADOW_CASTERS,
+		JOB_ROOM_SHADOW_CASTERS,
+	};
+
 	int CountRooms();
 
+	// conversion is split so that all the scene access is in Convert_Gather
+	void Convert_Begin(LRoomManager &manager, bool bVerbose, bool bPreparationRun, bool bDeleteLights, bool bSingleRoomMode);
+	void Convert_Gather();
+	void Convert_Process();
+	void Convert_End();
+	void Convert_ApplyNodeChanges();
+
+	static void Async_ThreadFunc(void * pUserData);
+	void Async_Wait();
+
 	void Convert_Rooms();
 	int Convert_Rooms_Recursive(Node * pParent, int count, int area);
 	bool Convert_Room(Spatial * pNode, int lroomID, int areaID);
@@ -98,14 +197,22 @@ private:
 
 	void Convert_Portals();
 	void Convert_Bounds();
-	bool Convert_ManualBound(LRoom &lroom, MeshInstance * pMI);
+	void Bound_Gather(int iRoomID);
+	void Bound_Finish(int iRoomID);
+	void Convert_ManualBound(LRoom &lroom, MeshInstance * pMI, Vector<Vector3> &points);
 	void GetWorldVertsFromMesh(const MeshInstance &mi, Vector<Vector3> &pts) const;
 	void Bound_FindPoints_Recursive(Node * pNode, Vector<Vector3> &pts);
 	bool Convert_Bound_FromPoints(LRoom &lroom, const Vector<Vector3> &points);
+	void Bound_Simplify(LRoom &lroom, const Vector<Vector3> &points, const Geometry::MeshData &md, int max_planes);
 	void Convert_ShadowCasters();
 	void Convert_Lights();
 	void Convert_AreaLights();
 
+	// streaming
+	Spatial * Reload_FindRoom(Node * pParent, const String &szName) const;
+	bool Reload_Room(LRoom &lroom, Spatial * pGRoom);
+	void Reload_FindObjects_Recursive(Node * pParent);
+
 
 	void LRoom_DetectPortalMeshes(LRoom &lroom, LTempRoom &troom);
 	void LRoom_MakePortalsTwoWay(LRoom &lroom, LTempRoom &troom, int iRoomNum);
@@ -120,10 +227,43 @@ private:
 	void LRoom_DetectedArea(LRoom &lroom, Node * pNode);
 
 	// shadows
-	void LRoom_FindShadowCasters_FromLight(LRoom &lroom, const LLight &light);
-	void LRoom_FindShadowCasters_Recursive(LRoom &source_lroom, int depth, LRoom &lroom, const LLight &light, const LVector<Plane> &planes);
+	void LRoom_FindShadowCasters_FromLight(LWorker &w, const LRoom &lroom, const LLight &light, LVector<int> &casters);
+	void LRoom_FindShadowCasters_Recursive(LWorker &w, int depth, const LRoom &lroom, const LLight &light, const LVector<Plane> &planes, LVector<int> &casters);
 	void LRoom_AddShadowCaster_SOB(LRoom &lroom, int sobID);
 
+	// timing of each phase
+	void Timing_Begin();
+	void Timing_Phase(const String &szPhase);
+
+	// threading
+	void Workers_Create(bool bVerbose);
+	void Workers_Prepare();
+	void Workers_Destroy();
+	void Jobs_Run(eJob job, int nJobs);
+	void Jobs_Worker(LWorker &w);
+	static void Jobs_ThreadFunc(void * pUserData);
+	void Job_Bound(int iRoomID);
+	void Job_LightTrace(LWorker &w, int iLightID);
+	void Job_ShadowCasters(LWorker &w, int iLightID);
+	void Job_RoomShadowCasters(LWorker &w, int iRoomID);
+
+	// reconversion
+	void Reconvert_FindNeighbours(const LRoom &lroom, LVector<int> &neighbours) const;
+	void Reconvert_RoomSOBs(LRoom &lroom, Spatial * pGRoom);
+	void Reconvert_Portals(LRoom &lroom, Spatial * pGRoom);
+	void Reconvert_Lights(const LVector<int> &rooms);
+	void Reconvert_ShadowCasters(int iRoomID);
+
+	// graph optimization
+	void Optimize_Graph();
+	int Optimize_MergeRooms();
+	bool Optimize_CanMergeRoom(int iRoomID) const;
+	void Optimize_CompactRooms(LVector<int> &groups);
+	int Optimize_CoalescePortals(LTempRoom &troom, const String &szRoom);
+	static int Optimize_FindGroup(LVector<int> &groups, int iRoomID);
+	static float Optimize_HullVolume(const Vector<Vector3> &points, Vector<Vector3> &hull_points);
+	static float Optimize_PortalArea(const LPortal &port);
+
 
 	void TRoom_MakeOppositePortal(const LPortal &port, int iRoomOrig);
 
@@ -135,6 +275,7 @@ private:
 	bool Node_IsBound(Node * pNode) const;
 	bool Node_IsIgnore(Node * pNode) const;
 	bool Node_IsLight(Node * pNode) const;
+	void Node_Delete(Node * pNode, bool bDetach);
 
 	int FindRoom_ByName(String szName) const;
 	int Area_FindOrCreate(String szName);
@@ -145,8 +286,38 @@ private:
 	Spatial * m_pRoomList; // room list pointed to by the manager nodepath
 
 	LVector<LTempRoom> m_TempRooms;
+	LVector<ObjectID> m_DeletedNodes;
+
+	// nodes to be removed from the scene tree when the node changes are deferred
+	LVector<ObjectID> m_DetachedNodes;
+	bool m_bDeferNodeChanges;
+
+	// async conversion
+	Thread * m_pAsyncThread;
+	// polled from the main thread while the conversion thread writes them
+	std::atomic<int> m_iAsyncStep;
+	std::atomic<bool> m_bAsyncDone;
 
-	bool Bound_AddPlaneIfUnique(LVector<Plane> &planes, const Plane &p);
+	// name lookups, so finding rooms and areas doesn't depend on the number of them
+	HashMap<String, int> m_RoomNames;
+	HashMap<String, int> m_AreaNames;
+
+	uint64_t m_uiTimingStart;
+	uint64_t m_uiTimingLast;
+	String m_szTimings;
+
+	// worker 0 is the main thread
+	LVector<LWorker *> m_Workers;
+	LVector<LLightJob> m_LightJobs;
+
+	// the job being run, set before the worker threads are started
+	eJob m_eJob;
+	int m_iNumJobs;
+	int m_iNumJobThreads;
+
+	// objects found when reloading a room
+	LVector<VisualInstance *> m_Reload_VIs;
+	LVector<Light *> m_Reload_Lights;
 
 
 	// whether we are preparing the level, or doing a final run,
@@ -154,4 +325,7 @@ private:
 	bool m_bFinalRun;
 	bool m_bDeleteLights;
 	bool m_bSingleRoomMode;
+
+	// lights and areas are kept as they were when reconverting a room
+	bool m_bReconvert;
 };
@@ -0,0 +1,345 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lroom_grid.h"
+#include "lroom_manager.h"
+
+
+LRoomGrid::LRoomGrid()
+{
+	Clear();
+}
+
+void LRoomGrid::Clear()
+{
+	m_bValid = false;
+	m_iNumRooms = 0;
+	m_uiQuery = 0;
+
+	for (int n=0; n<3; n++)
+		m_iDims[n] = 0;
+
+	m_CellStart.clear(true);
+	m_Items.clear(true);
+	m_CentreStart.clear(true);
+	m_Centres.clear(true);
+	m_Found.clear(true);
+}
+
+void LRoomGrid::GetCell(const Vector3 &pt, int &x, int &y, int &z) const
+{
+	// points outside the grid go in the edge cells
+	x = CLAMP((int) Math::floor((pt.x - m_ptMin.x) * m_ptInvCellSize.x), 0, m_iDims[0] - 1);
+	y = CLAMP((int) Math::floor((pt.y - m_ptMin.y) * m_ptInvCellSize.y), 0, m_iDims[1] - 1);
+	z = CLAMP((int) Math::floor((pt.z - m_ptMin.z) * m_ptInvCellSize.z), 0, m_iDims[2] - 1);
+}
+
+void LRoomGrid::Create(const LRoomManager &manager)
+{
+	Clear();
+
+	int nRooms = manager.m_Rooms.size();
+	if (!nRooms)
+		return;
+
+	// the grid must contain the centres as well as the room AABBs
+	LVector<AABB> boxes;
+	LVector<AABB> centres;
+	boxes.resize(nRooms);
+	centres.resize(nRooms);
+
+	AABB bb_all;
+	for (int n=0; n<nRooms; n++)
+	{
+		const LRoom &lroom = manager.m_Rooms[n];
+		boxes[n] = lroom.m_AABB;
+		centres[n] = AABB(lroom.m_ptCentre, Vector3(0, 0, 0));
+
+		if (n == 0)
+			bb_all = boxes[n];
+		else
+			bb_all.merge_with(boxes[n]);
+
+		bb_all.expand_to(lroom.m_ptCentre);
+	}
+
+	// aim for roughly one room per cell, flat levels get a single layer
+	Vector3 ptSize = bb_all.size;
+	for (int n=0; n<3; n++)
+		ptSize[n] = MAX(ptSize[n], 0.001f);
+
+	float cell_size = Math::pow((ptSize.x * ptSize.y * ptSize.z) / nRooms, 1.0f / 3.0f);
+
+	m_ptMin = bb_all.position;
+	for (int n=0; n<3; n++)
+	{
+		m_iDims[n] = CLAMP((int) Math::ceil(ptSize[n] / cell_size), 1, 64);
+		m_ptCellSize[n] = ptSize[n] / m_iDims[n];
+		m_ptInvCellSize[n] = 1.0f / m_ptCellSize[n];
+	}
+
+	Fill(boxes, m_CellStart, m_Items);
+	Fill(centres, m_CentreStart, m_Centres);
+
+	m_Found.resize(nRooms);
+	for (int n=0; n<nRooms; n++)
+		m_Found[n] = 0;
+
+	m_iNumRooms = nRooms;
+	m_bValid = true;
+}
+
+void LRoomGrid::Fill(const LVector<AABB> &boxes, LVector<int> &start, LVector<int> &items) const
+{
+	int nCells = m_iDims[0] * m_iDims[1] * m_iDims[2];
+
+	// count the items in each cell, then place them
+	start.resize(nCells + 1);
+	for (int n=0; n<=nCells; n++)
+		start[n] = 0;
+
+	LVector<int> fill;
+
+	for (int pass=0; pass<2; pass++)
+	{
+		// rooms are placed in ascending order within each cell, which the tie breaks rely on
+		for (int n=0; n<boxes.size(); n++)
+		{
+			const AABB &bb = boxes[n];
+
+			int lo[3], hi[3];
+			GetCell(bb.position, lo[0], lo[1], lo[2]);
+			GetCell(bb.position + bb.size, hi[0], hi[1], hi[2]);
+
+			for (int z=lo[2]; z<=hi[2]; z++)
+			{
+				for (int y=lo[1]; y<=hi[1]; y++)
+				{
+					for (int x=lo[0]; x<=hi[0]; x++)
+					{
+						int cell = GetCellID(x, y, z);
+
+						if (pass == 0)
+							start[cell + 1]++;
+						else
+							items[fill[cell]++] = n;
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (int c=0; c<nCells; c++)
+				start[c + 1] += start[c];
+
+			items.resize(start[nCells]);
+
+			// fill position of each cell while placing
+			fill.resize(nCells);
+			for (int c=0; c<nCells; c++)
+				fill[c] = start[c];
+		}
+	}
+}
+
+int LRoomGrid::FindClosestRoom(const LRoomManager &manager, const Vector3 &pt) const
+{
+	float within_dist;
+	int closest_within = FindClosestWithin(manager, pt, within_dist);
+
+	// some logic whether to use the hulls or the closest dist
+	if (within_dist < 1.0f)
+		return closest_within;
+
+	return FindClosestCentre(manager, pt);
+}
+
+// any room whose AABB contains the point must be listed in the cell containing the point
+int LRoomGrid::FindClosestWithin(const LRoomManager &manager, const Vector3 &pt, float &within_dist) const
+{
+	int closest_within = -1;
+	within_dist = FLT_MAX;
+
+	int x, y, z;
+	GetCell(pt, x, y, z);
+	int cell = GetCellID(x, y, z);
+
+	int last_item = m_CellStart[cell + 1];
+	for (int i=m_CellStart[cell]; i<last_item; i++)
+	{
+		int n = m_Items[i];
+		const LRoom &lroom = manager.m_Rooms[n];
+
+		if (!lroom.m_bLoaded || !lroom.m_Bound.IsActive())
+			continue;
+
+		if (!lroom.m_AABB.has_point(pt))
+			continue;
+
+		float dist = lroom.m_Bound.GetSmallestPenetrationDistance(pt);
+
+		if (dist < within_dist)
+		{
+			closest_within = n;
+			within_dist = dist;
+		}
+	}
+
+	return closest_within;
+}
+
+float LRoomGrid::DistanceToUnsearched(const Vector3 &pt, const int * lo, const int * hi) const
+{
+	float dist = FLT_MAX;
+
+	for (int a=0; a<3; a++)
+	{
+		if (lo[a] > 0)
+			dist = MIN(dist, pt[a] - (m_ptMin[a] + (lo[a] * m_ptCellSize[a])));
+		if (hi[a] < (m_iDims[a] - 1))
+			dist = MIN(dist, (m_ptMin[a] + ((hi[a] + 1) * m_ptCellSize[a])) - pt[a]);
+	}
+
+	return dist;
+}
+
+void LRoomGrid::FindClosestCentre_Cell(const LRoomManager &manager, const Vector3 &pt, int cell, int &closest, float &closest_dist) const
+{
+	int last_item = m_CentreStart[cell + 1];
+
+	for (int i=m_CentreStart[cell]; i<last_item; i++)
+	{
+		int n = m_Centres[i];
+		const LRoom &lroom = manager.m_Rooms[n];
+		if (!lroom.m_bLoaded)
+			continue;
+
+		float d = pt.distance_squared_to(lroom.m_ptCentre);
+
+		// lowest room id wins a tie, as in a linear search
+		if ((d < closest_dist) || ((d == closest_dist) && (n < closest)))
+		{
+			closest = n;
+			closest_dist = d;
+		}
+	}
+}
+
+// search outwards in shells of cells until no unsearched cell can contain a closer centre
+int LRoomGrid::FindClosestCentre(const LRoomManager &manager, const Vector3 &pt) const
+{
+	int closest = -1;
+	float closest_dist = FLT_MAX;
+
+	int c[3];
+	GetCell(pt, c[0], c[1], c[2]);
+
+	int max_r = MAX(m_iDims[0], MAX(m_iDims[1], m_iDims[2]));
+
+	for (int r=0; r<max_r; r++)
+	{
+		int lo[3], hi[3];
+		for (int a=0; a<3; a++)
+		{
+			lo[a] = MAX(c[a] - r, 0);
+			hi[a] = MIN(c[a] + r, m_iDims[a] - 1);
+		}
+
+		for (int z=lo[2]; z<=hi[2]; z++)
+		{
+			bool bShellZ = (z == c[2] - r) || (z == c[2] + r);
+
+			for (int y=lo[1]; y<=hi[1]; y++)
+			{
+				bool bShellYZ = bShellZ || (y == c[1] - r) || (y == c[1] + r);
+
+				if (bShellYZ)
+				{
+					for (int x=lo[0]; x<=hi[0]; x++)
+						FindClosestCentre_Cell(manager, pt, GetCellID(x, y, z), closest, closest_dist);
+					continue;
+				}
+
+				// cells inside the shell were searched on an earlier pass
+				if ((c[0] - r) >= 0)
+					FindClosestCentre_Cell(manager, pt, GetCellID(c[0] - r, y, z), closest, closest_dist);
+				if ((r != 0) && ((c[0] + r) < m_iDims[0]))
+					FindClosestCentre_Cell(manager, pt, GetCellID(c[0] + r, y, z), closest, closest_dist);
+			}
+		}
+
+		float dist = DistanceToUnsearched(pt, lo, hi);
+
+		// whole grid searched
+		if (dist == FLT_MAX)
+			break;
+
+		// allow for rounding at the cell edges, so an equidistant centre can't be missed
+		dist -= 0.001f * MIN(m_ptCellSize.x, MIN(m_ptCellSize.y, m_ptCellSize.z));
+
+		if ((closest != -1) && (dist > 0.0f) && (closest_dist < (dist * dist)))
+			break;
+	}
+
+	return closest;
+}
+
+void LRoomGrid::FindRooms(const LRoomManager &manager, const AABB &bb, LVector<int> &rooms)
+{
+	rooms.clear();
+
+	if (!m_bValid)
+		return;
+
+	m_uiQuery++;
+
+	int lo[3], hi[3];
+	GetCell(bb.position, lo[0], lo[1], lo[2]);
+	GetCell(bb.position + bb.size, hi[0], hi[1], hi[2]);
+
+	for (int z=lo[2]; z<=hi[2]; z++)
+	{
+		for (int y=lo[1]; y<=hi[1]; y++)
+		{
+			for (int x=lo[0]; x<=hi[0]; x++)
+			{
+				int cell = GetCellID(x, y, z);
+				int last_item = m_CellStart[cell + 1];
+
+				for (int i=m_CellStart[cell]; i<last_item; i++)
+				{
+					int n = m_Items[i];
+					if (m_Found[n] == m_uiQuery)
+						continue;
+					m_Found[n] = m_uiQuery;
+
+					if (manager.m_Rooms[n].m_AABB.intersects_inclusive(bb))
+						rooms.push_back(n);
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/aabb.h"
+
+class LRoomManager;
+
+// Finding the room containing a point (on dob registration, dobs leaving their room bound, camera teleports)
+// used to test every room. Instead a uniform 3D grid is built at conversion, with the rooms listed in each
+// cell their AABB overlaps, and a second list of the rooms whose centre is in each cell.
+// The queries give exactly the same results as testing every room, including the tie breaks.
+class LRoomGrid
+{
+public:
+	LRoomGrid();
+	void Clear();
+
+	void Create(const LRoomManager &manager);
+	bool IsValid(int nRooms) const {return m_bValid && (m_iNumRooms == nRooms);}
+
+	// same rules as a linear search, see LRoomManager::FindClosestRoom
+	int FindClosestRoom(const LRoomManager &manager, const Vector3 &pt) const;
+
+	// rooms whose AABB overlaps the box
+	void FindRooms(const LRoomManager &manager, const AABB &bb, LVector<int> &rooms);
+
+private:
+	int FindClosestWithin(const LRoomManager &manager, const Vector3 &pt, float &within_dist) const;
+	int FindClosestCentre(const LRoomManager &manager, const Vector3 &pt) const;
+	void FindClosestCentre_Cell(const LRoomManager &manager, const Vector3 &pt, int cell, int &closest, float &closest_dist) const;
+
+	void GetCell(const Vector3 &pt, int &x, int &y, int &z) const;
+	int GetCellID(int x, int y, int z) const {return (((z * m_iDims[1]) + y) * m_iDims[0]) + x;}
+
+	// distance from the point to the nearest cell outside the box of cells, or FLT_MAX if there are none
+	float DistanceToUnsearched(const Vector3 &pt, const int * lo, const int * hi) const;
+
+	// items for each cell are contiguous, cell n from start[n] to start[n+1]
+	void Fill(const LVector<AABB> &boxes, LVector<int> &start, LVector<int> &items) const;
+
+	bool m_bValid;
+	int m_iNumRooms;
+
+	Vector3 m_ptMin;
+	Vector3 m_ptCellSize;
+	Vector3 m_ptInvCellSize;
+	int m_iDims[3];
+
+	// rooms by AABB overlap
+	LVector<int> m_CellStart;
+	LVector<int> m_Items;
+
+	// rooms by centre
+	LVector<int> m_CentreStart;
+	LVector<int> m_Centres;
+
+	// rooms can be in more than one cell, only add them once per query
+	LVector<unsigned int> m_Found;
+	unsigned int m_uiQuery;
+};
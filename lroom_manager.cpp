@@ -23,6 +23,7 @@
 #include "scene/3d/camera.h"
 #include "scene/3d/mesh_instance.h"
 #include "lroom_converter.h"
+#include "lconvert_cache.h"
 #include "ldebug.h"
 #include "scene/3d/immediate_geometry.h"
 #include "scene/3d/light.h"
@@ -35,10 +36,18 @@
 #define LROOMLIST m_pRoomList
 #define CHECK_ROOM_LIST if (!CheckRoomList())\
 {\
-WARN_PRINT_ONCE("rooms is unset");\
+WARN_PRINT_ONCE("rooms is unset, or converting");\
 return false;\
 }
 
+// for the entry points that don't need the roomlist, but still read the rooms, lights or dobs
+// the conversion thread is writing to
+#define CHECK_NOT_CONVERTING(a, b) if (m_pAsyncConvert)\
+{\
+WARN_PRINT_ONCE(a " : converting");\
+return b;\
+}
+
 
 LRoomManager::LRoomManager()
 {
@@ -58,6 +67,21 @@ LRoomManager::LRoomManager()
 	m_bFrustumOnly = false;
 
 	m_bPortalPlane_Convention = false;
+	m_iPortalMaxVerts = 8;
+	m_iBoundMaxPlanes = 0;
+	m_bGraphOptimization = false;
+	m_iMergeMaxObjects = 0;
+	m_bShadowReceiverCulling = true;
+	m_bLightLayers = false;
+	m_iSunGrid_Tested = 0;
+	m_iDobsAutoMoved = 0;
+	m_bDirectionalSplits = false;
+	m_fCasterCacheMargin = 1.0f;
+	m_iCasterCache_Hits = 0;
+	m_iCasterCache_Refreshes = 0;
+	m_pAsyncConvert = 0;
+	m_pAsyncCache = 0;
+	m_fAsyncProgress = 0.0f;
 
 	// to know which rooms to hide we keep track of which were shown this, and the previous frame
 	m_pCurr_VisibleRoomList = &m_VisibleRoomList_A;
@@ -87,8 +111,20 @@ LRoomManager::LRoomManager()
 	}
 }
 
+LRoomManager::~LRoomManager()
+{
+	// the conversion thread must finish, but the scene is going so the results are not needed
+	if (m_pAsyncConvert)
+		memdelete(m_pAsyncConvert);
+	if (m_pAsyncCache)
+		memdelete(m_pAsyncCache);
+}
+
 int LRoomManager::FindClosestRoom(const Vector3 &pt) const
 {
+	// gives the same result as the linear search below
+	if (m_RoomGrid.IsValid(m_Rooms.size()))
+		return m_RoomGrid.FindClosestRoom(*this, pt);
 
 	//print_line("FindClosestRoom");
 	int closest = -1;
@@ -101,6 +137,8 @@ int LRoomManager::FindClosestRoom(const Vector3 &pt) const
 	for (int n=0; n<m_Rooms.size(); n++)
 	{
 		const LRoom &lroom = m_Rooms[n];
+		if (!lroom.m_bLoaded)
+			continue;
 
 		float d = pt.distance_squared_to(lroom.m_ptCentre);
 
@@ -140,6 +178,130 @@ int LRoomManager::FindClosestRoom(const Vector3 &pt) const
 }
 
 
+int LRoomManager::Area_Find(String szName) const
+{
+	for (int n=0; n<m_Areas.size(); n++)
+	{
+		if (m_Areas[n].m_szName == szName)
+			return n;
+	}
+
+	return -1;
+}
+
+// by the node, or by name for a new instance of the room node
+int LRoomManager::Room_FindByNode(Node * pRoomNode) const
+{
+	ObjectID id = pRoomNode->get_instance_id();
+	String szName = LPortal::FindNameAfter(pRoomNode, "room_");
+
+	// merged rooms have more than one node
+	if (m_UserRooms.size())
+	{
+		for (int n=0; n<m_UserRooms.size(); n++)
+		{
+			if (m_UserRooms[n].m_GodotID == id)
+				return m_UserRooms[n].m_iRoom;
+		}
+
+		for (int n=0; n<m_UserRooms.size(); n++)
+		{
+			if (m_UserRooms[n].m_szName == szName)
+				return m_UserRooms[n].m_iRoom;
+		}
+
+		return -1;
+	}
+
+	for (int n=0; n<m_Rooms.size(); n++)
+	{
+		if (m_Rooms[n].m_GodotID == id)
+			return n;
+	}
+
+	for (int n=0; n<m_Rooms.size(); n++)
+	{
+		if (m_Rooms[n].m_szName == szName)
+			return n;
+	}
+
+	return -1;
+}
+
+// the list of user rooms for each room, in user id order
+void LRoomManager::UserRooms_Create()
+{
+	m_RoomUsers_First.clear();
+	m_RoomUsers.clear();
+
+	if (!m_UserRooms.size())
+		return;
+
+	int nRooms = m_Rooms.size();
+	m_RoomUsers_First.resize(nRooms + 1);
+	for (int n=0; n<=nRooms; n++)
+		m_RoomUsers_First[n] = 0;
+
+	// count, then offsets
+	for (int n=0; n<m_UserRooms.size(); n++)
+		m_RoomUsers_First[m_UserRooms[n].m_iRoom + 1]++;
+
+	for (int n=0; n<nRooms; n++)
+		m_RoomUsers_First[n + 1] += m_RoomUsers_First[n];
+
+	m_RoomUsers.resize(m_UserRooms.size());
+	for (int n=0; n<m_UserRooms.size(); n++)
+	{
+		int &slot = m_RoomUsers_First[m_UserRooms[n].m_iRoom];
+		m_RoomUsers[slot++] = n;
+	}
+
+	// filling moved each offset on to the next room
+	for (int n=nRooms; n>0; n--)
+		m_RoomUsers_First[n] = m_RoomUsers_First[n - 1];
+	m_RoomUsers_First[0] = 0;
+}
+
+int LRoomManager::Room_FromUser(int user_id) const
+{
+	if (!m_UserRooms.size())
+		return user_id;
+
+	if ((unsigned int) user_id >= (unsigned int) m_UserRooms.size())
+		return -1;
+
+	return m_UserRooms[user_id].m_iRoom;
+}
+
+// a merged room is reported as its lowest user id
+int LRoomManager::Room_ToUser(int room_id) const
+{
+	if (!m_UserRooms.size() || (room_id < 0))
+		return room_id;
+
+	return m_RoomUsers[m_RoomUsers_First[room_id]];
+}
+
+void LRoomManager::Room_AddUsers(int room_id, Array &rooms) const
+{
+	if (!m_UserRooms.size())
+	{
+		rooms.push_back(room_id);
+		return;
+	}
+
+	for (int n=m_RoomUsers_First[room_id]; n<m_RoomUsers_First[room_id + 1]; n++)
+		rooms.push_back(m_RoomUsers[n]);
+}
+
+bool LRoomManager::Room_IsMerged(int room_id) const
+{
+	if (!m_UserRooms.size())
+		return false;
+
+	return (m_RoomUsers_First[room_id + 1] - m_RoomUsers_First[room_id]) > 1;
+}
+
 const LRoom * LRoomManager::GetRoom(int i) const
 {
 	if ((unsigned int) i >= (unsigned int) m_Rooms.size())
@@ -360,15 +522,19 @@ int LRoomManager::DobRegister(Spatial * pDOB, const Vector3 &pos, float radius,
 	if (iRoom == -1)
 	{
 		WARN_PRINT_ONCE("LRoomManager::DobRegister : room ID is -1");
-		return false;
+		return -1;
 	}
 
 	int did = m_DobList.Request();
+	if (did == -1)
+		return -1;
+
 	LDob &dob = m_DobList.GetDob(did);
 
-	dob.m_iRoomID = iRoom;
+	m_DobList.ChangeRoom(*this, did, iRoom);
 	dob.m_ID_Spatial = pDOB->get_instance_id();
 	dob.m_fRadius = radius;
+	dob.m_ptPos = pos;
 
 //	LRoom * pRoom = GetRoom(iRoom);
 //	if (!pRoom)
@@ -387,21 +553,19 @@ int LRoomManager::DobRegister(Spatial * pDOB, const Vector3 &pos, float radius,
 	// save the room ID on the dob metadata
 //	Meta_SetRoomNum(pDOB, iRoom);
 
-#ifdef LPORTAL_DOBS_NO_SOFTSHOW
-	VisualInstance * pVI = dob.GetVI();
-	if (pVI)
-	{
-		uint32_t mask = 0;
-		mask = LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT;
-		LRoom::SoftShow(pVI, mask);
-	}
-#endif
+	dob.SetLayerMask(LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT);
 
-	// change visibility
 	m_DobList.UpdateDob(*this, did, pos);
-//	DobUpdateVisibility(pDOB, pRoom);
 
-	return did;
+#ifdef LPORTAL_DOBS_AUTO_UPDATE
+	m_DobList.SetAutoUpdate(did, true);
+#endif
+
+	// the dob starts shown, and will be hidden on the next frame if it is not in view
+	m_VisibleList_DOBs.push_back(did);
+
+	// script refers to the dob by handle
+	return m_DobList.GetHandle(did);
 }
 
 
@@ -518,13 +682,16 @@ int LRoomManager::DobUpdate(Spatial * pDOB_Spatial, LRoom * pRoom)
 
 int LRoomManager::dob_update(int dob_id, const Vector3 &pos)
 {
-#ifdef LPORTAL_DOBS_AUTO_UPDATE
-	return -1;
-#endif
-
+	CHECK_NOT_CONVERTING("dob_update", -1)
 
+	int slot = m_DobList.FindSlot(dob_id);
+	if (slot == -1)
+	{
+		WARN_PRINT_ONCE("dob_update : invalid dob_id (unregistered?)");
+		return -1;
+	}
 
-	return m_DobList.UpdateDob(*this, dob_id, pos);
+	return Room_ToUser(m_DobList.UpdateDob(*this, slot, pos));
 
 
 
@@ -540,6 +707,48 @@ int LRoomManager::dob_update(int dob_id, const Vector3 &pos)
 //	return DobUpdate(pSpat, pRoom);
 }
 
+// Large numbers of moving dobs cost a script call each with dob_update. In a batch the arrays are
+// only marshalled once, and as visibility is applied at the end of the frame the update is just
+// the room change detection.
+PoolIntArray LRoomManager::dob_update_batch(const PoolIntArray &dob_ids, const PoolVector3Array &positions)
+{
+	PoolIntArray rooms;
+	CHECK_NOT_CONVERTING("dob_update_batch", rooms)
+
+	int nDOBs = dob_ids.size();
+	if (positions.size() != nDOBs)
+	{
+		WARN_PRINT_ONCE("dob_update_batch : dob_ids and positions are different sizes");
+		return rooms;
+	}
+
+	rooms.resize(nDOBs);
+
+	PoolIntArray::Read ids = dob_ids.read();
+	PoolVector3Array::Read pts = positions.read();
+	PoolIntArray::Write room_ids = rooms.write();
+
+	bool bInvalid = false;
+
+	for (int n=0; n<nDOBs; n++)
+	{
+		int slot = m_DobList.FindSlot(ids[n]);
+		if (slot == -1)
+		{
+			bInvalid = true;
+			room_ids[n] = -1;
+			continue;
+		}
+
+		room_ids[n] = Room_ToUser(m_DobList.UpdateDob(*this, slot, pts[n]));
+	}
+
+	if (bInvalid)
+		WARN_PRINT_ONCE("dob_update_batch : invalid dob_id (unregistered?)");
+
+	return rooms;
+}
+
 /*
 bool LRoomManager::dob_teleport_hint(Node * pDOB, Node * pRoom)
 {
@@ -664,7 +873,22 @@ bool LRoomManager::dob_unregister(int dob_id)
 //		return pRoom->DOB_Remove(dob_id);
 //	}
 
-	m_DobList.DeleteDob(dob_id);
+	int slot = m_DobList.FindSlot(dob_id);
+	if (slot == -1)
+	{
+		WARN_PRINT_ONCE("dob_unregister : invalid dob_id (unregistered?)");
+		return false;
+	}
+
+	// the camera can't be culled without a dob
+	if (slot == m_DOB_id_camera)
+		m_DOB_id_camera = -1;
+
+	// leave the object shown, it is no longer culled
+	LDob &dob = m_DobList.GetDob(slot);
+	dob.Show(true);
+	dob.SetLayerMask(LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT);
+	m_DobList.DeleteDob(*this, slot);
 
 	return true;
 }
@@ -691,6 +915,21 @@ bool LRoomManager::Light_FindCasters(int lightID)
 {
 	// add all shadow casters for this light (new method)
 	const LLight &light = m_Lights[lightID];
+
+	// static lights can reuse the casters found on a previous frame
+	if (Light_UsesCasterCache(light))
+	{
+		// if the cache can't be created, fall back to a full trace
+		if (Light_UpdateCasterCache(lightID))
+		{
+			const LCasterCache &cache = m_CasterCaches[lightID];
+			if (!cache.m_bInView)
+				return false;
+
+			Light_AddCasters(lightID, cache.m_Casters, cache.m_Rooms);
+			return true;
+		}
+	}
 /*
 	if (light.m_eClass == LLight::LT_STATIC)
 	{
@@ -719,7 +958,7 @@ bool LRoomManager::Light_FindCasters(int lightID)
 	if (light.m_iArea != -1)
 	{
 		// special trace for area light
-		if (m_Trace.Trace_Light(*this, light, LTrace::LR_ALL) == false)
+		if (Light_TraceSunGrid(lightID) == false)
 			return false;
 	}
 	else
@@ -734,6 +973,21 @@ bool LRoomManager::Light_FindCasters(int lightID)
 		if (!pRoom)
 			return true;
 
+		bool bScheduled = m_LightScheduler.IsActive() && (light.m_Source.m_eClass == LSource::SC_DYNAMIC);
+
+		// dynamic lights waiting for their turn to be retraced reuse their previous casters
+		if (bScheduled && m_LightScheduler.IsPending(lightID) && m_LightScheduler.HasCasters(lightID))
+			return Light_AddCasters_Pending(lightID);
+
+		// The casters kept for the frames the light is pending must not depend on the camera,
+		// as it may move or turn in the meantime. They are clipped to the view each frame instead.
+		if (bScheduled)
+		{
+			m_Trace.Trace_Light(*this, light, LTrace::LR_CASTERS);
+			m_LightScheduler.StoreCasters(lightID, m_LightRender.m_Temp_Visible_SOBs, m_LightRender.m_Temp_Visible_Rooms);
+			return Light_AddCasters_InView(lightID, m_LightRender.m_Temp_Visible_SOBs, m_LightRender.m_Temp_Visible_Rooms);
+		}
+
 		if (m_Trace.Trace_Light(*this, light, LTrace::LR_ALL) == false)
 			return false;
 
@@ -767,14 +1021,47 @@ bool LRoomManager::Light_FindCasters(int lightID)
 	// we no longer need these planes
 	m_Pool.Free(pool_member);
 */
+	Light_AddCasters(lightID, m_LightRender.m_Temp_Visible_SOBs, m_LightRender.m_Temp_Visible_Rooms);
+	return true;
+}
+
+void LRoomManager::Light_AddCasters(int lightID, const LVector<int> &casters, const LVector<int> &lit_rooms)
+{
+	const LLight &light = m_Lights[lightID];
+
+	// casters only matter if their shadows can fall within the regions of the rooms the camera can see,
+	// and that are reached by this light
+	if (m_bShadowReceiverCulling)
+		m_Receivers.Light_Begin(light.m_Source, lit_rooms);
+
+	if (m_bLightLayers)
+		m_LightLayers.Light_Begin(lightID);
+
+	if (m_bDirectionalSplits && (light.m_Source.m_eType == LSource::ST_DIRECTIONAL))
+		Light_FindSplitCasters(lightID, casters);
+
 	// process the sobs that were visible
-	for (int n=0; n<m_LightRender.m_Temp_Visible_SOBs.size(); n++)
+	for (int n=0; n<casters.size(); n++)
 	{
-		int sobID = m_LightRender.m_Temp_Visible_SOBs[n];
+		int sobID = casters[n];
 
 		// only add to the caster list if not in it already (does this check need to happen, can this ever occur?)
-		if (!m_BF_caster_SOBs.GetBit(sobID))
+		// With light layers each light still needs its own record of shared casters.
+		bool bCaster = m_BF_caster_SOBs.GetBit(sobID) != 0;
+		if (!bCaster || m_bLightLayers)
 		{
+			if (m_bShadowReceiverCulling && !m_Receivers.Light_IsCasterRelevant(m_SOBs[sobID].m_aabb))
+			{
+				m_Receivers.m_iNumCulled++;
+				continue;
+			}
+
+			if (m_bLightLayers)
+				m_LightLayers.Light_AddCaster(sobID, m_SOBs[sobID].m_aabb);
+
+			if (bCaster)
+				continue;
+
 			LPRINT_RUN(2, "\t" + itos(sobID) + ", " + m_SOBs[sobID].GetSpatial()->get_name());
 			m_BF_caster_SOBs.SetBit(sobID, true);
 			m_CasterList_SOBs.push_back(sobID);
@@ -786,9 +1073,448 @@ bool LRoomManager::Light_FindCasters(int lightID)
 
 	}
 
+	Light_AddCasterDOBs(lightID, lit_rooms);
+}
+
+// Dobs move, so they can't be part of the traced or cached caster lists. Instead the dobs in the rooms
+// reached by the light are tested against the volume the light can cast shadows into the view from.
+void LRoomManager::Light_AddCasterDOBs(int lightID, const LVector<int> &lit_rooms)
+{
+	const LLight &light = m_Lights[lightID];
+
+	unsigned int pool_member = (unsigned int) -1;
+	LVector<Plane> * pPlanes = 0;
+
+	for (int r=0; r<lit_rooms.size(); r++)
+	{
+		const LRoom &lroom = m_Rooms[lit_rooms[r]];
+
+		for (int dob_id = lroom.m_iFirstDOB; dob_id != -1; dob_id = m_DobList.GetDob(dob_id).m_iNextInRoom)
+		{
+			// already shown
+			if (m_BF_visible_DOBs.GetBit(dob_id) || m_BF_caster_DOBs.GetBit(dob_id))
+				continue;
+
+			if (dob_id == m_DOB_id_camera)
+				continue;
+
+			// only create the planes if there are dobs to test
+			if (!pPlanes)
+			{
+				pool_member = m_Pool.Request();
+				assert (pool_member != (unsigned int) -1);
+
+				pPlanes = &m_Pool.Get(pool_member);
+				pPlanes->clear();
+
+				if (!m_MainCamera.AddCameraLightPlanes(*this, light.m_Source, *pPlanes))
+				{
+					m_Pool.Free(pool_member);
+					return;
+				}
+			}
+
+			const LDob &dob = m_DobList.GetDob(dob_id);
+
+			bool bCaster = true;
+			for (int p=0; p<pPlanes->size(); p++)
+			{
+				if ((*pPlanes)[p].distance_to(dob.m_ptPos) > dob.m_fRadius)
+				{
+					bCaster = false;
+					break;
+				}
+			}
+
+			if (!bCaster)
+				continue;
+
+			if (m_bShadowReceiverCulling)
+			{
+				Vector3 ptRadius(dob.m_fRadius, dob.m_fRadius, dob.m_fRadius);
+				if (!m_Receivers.Light_IsCasterRelevant(AABB(dob.m_ptPos - ptRadius, ptRadius * 2.0f)))
+				{
+					m_Receivers.m_iNumCulled++;
+					continue;
+				}
+			}
+
+			m_BF_caster_DOBs.SetBit(dob_id, true);
+			m_CasterList_DOBs.push_back(dob_id);
+		}
+	}
+
+	if (pPlanes)
+		m_Pool.Free(pool_member);
+}
+
+// Area lights find their casters from a light space grid of the area sobs, rather than
+// testing every sob in every room of the area (as Trace_Light would).
+bool LRoomManager::Light_TraceSunGrid(int lightID)
+{
+	const LLight &light = m_Lights[lightID];
+	const LArea &area = m_Areas[light.m_iArea];
+
+	// lights may have been added or reconverted
+	if (m_SunGrids.size() != m_Lights.size())
+	{
+		m_SunGrids.resize(m_Lights.size());
+		for (int n=0; n<m_SunGrids.size(); n++)
+			m_SunGrids[n].Clear();
+	}
+
+	LSunGrid &grid = m_SunGrids[lightID];
+	if (!grid.IsValidFor(light.m_Source.m_ptDir))
+		grid.Create(*this, area, light.m_Source.m_ptDir);
+
+	LLightRender &lr = m_LightRender;
+	lr.m_BF_Temp_SOBs.Blank();
+	lr.m_Temp_Visible_SOBs.clear();
+	lr.m_BF_Temp_Visible_Rooms.Blank();
+	lr.m_Temp_Visible_Rooms.clear();
+
+	unsigned int pool_member = m_Pool.Request();
+	assert (pool_member != (unsigned int) -1);
+
+	LVector<Plane> &planes = m_Pool.Get(pool_member);
+	planes.clear();
+
+	bool bLightInView = m_MainCamera.AddCameraLightPlanes(*this, light.m_Source, planes);
+
+	if (bLightInView)
+	{
+		// the area light reaches all the rooms in the area
+		int last_room = area.m_iFirstRoom + area.m_iNumRooms;
+		for (int r=area.m_iFirstRoom; r<last_room; r++)
+		{
+			int room_id = m_AreaRooms[r];
+			if (lr.m_BF_Temp_Visible_Rooms.CheckAndSet(room_id))
+				lr.m_Temp_Visible_Rooms.push_back(room_id);
+		}
+
+		m_iSunGrid_Tested += grid.FindCasters(*this, m_MainCamera, planes, lr.m_BF_Temp_SOBs, lr.m_Temp_Visible_SOBs);
+	}
+
+	// we no longer need these planes
+	m_Pool.Free(pool_member);
+
+	return bLightInView;
+}
+
+// find the split distances (from the camera) used by godot for the shadow map of a directional light,
+// returns the number of splits, or 0 if the light has no shadow splits
+int LRoomManager::Light_GetSplitDistances(int lightID, float * pDistances) const
+{
+	const LLight &light = m_Lights[lightID];
+
+	Object * pObj = ObjectDB::get_instance(light.m_GodotID);
+	DirectionalLight * pDLight = Object::cast_to<DirectionalLight>(pObj);
+	if (!pDLight || !pDLight->has_shadow())
+		return 0;
+
+	// godot limits the shadow distance to the camera far plane
+	float max_dist = pDLight->get_param(Light::PARAM_SHADOW_MAX_DISTANCE);
+	float cam_far = -m_MainCamera.m_Planes[LMainCamera::P_FAR].distance_to(m_MainCamera.m_ptPos);
+	if ((max_dist <= 0.0f) || (max_dist > cam_far))
+		max_dist = cam_far;
+
+	int nSplits = 1;
+	switch (pDLight->get_shadow_mode())
+	{
+	case DirectionalLight::SHADOW_PARALLEL_2_SPLITS:
+		nSplits = 2;
+		pDistances[1] = max_dist * pDLight->get_param(Light::PARAM_SHADOW_SPLIT_1_OFFSET);
+		break;
+	case DirectionalLight::SHADOW_PARALLEL_4_SPLITS:
+		nSplits = 4;
+		pDistances[1] = max_dist * pDLight->get_param(Light::PARAM_SHADOW_SPLIT_1_OFFSET);
+		pDistances[2] = max_dist * pDLight->get_param(Light::PARAM_SHADOW_SPLIT_2_OFFSET);
+		pDistances[3] = max_dist * pDLight->get_param(Light::PARAM_SHADOW_SPLIT_3_OFFSET);
+		break;
+	default:
+		break;
+	}
+
+	pDistances[0] = 0.0f;
+	pDistances[nSplits] = max_dist;
+
+	return nSplits;
+}
+
+// each split only needs the casters within the slice of the view frustum it covers, extruded towards the light
+void LRoomManager::Light_FindSplitCasters(int lightID, const LVector<int> &casters)
+{
+	if (m_SplitCasters.size() != m_Lights.size())
+	{
+		m_SplitCasters.resize(m_Lights.size());
+		for (int n=0; n<m_SplitCasters.size(); n++)
+			m_SplitCasters[n].m_iNumSplits = 0;
+	}
+
+	LSplitCasters &sc = m_SplitCasters[lightID];
+	sc.m_uiFrame = m_uiFrameCounter;
+
+	for (int s=0; s<MAX_SHADOW_SPLITS; s++)
+		sc.m_Casters[s].clear();
+
+	float distances[MAX_SHADOW_SPLITS + 1];
+	sc.m_iNumSplits = Light_GetSplitDistances(lightID, distances);
+
+	const LSource &source = m_Lights[lightID].m_Source;
+
+	unsigned int pool_member = m_Pool.Request();
+	assert (pool_member != (unsigned int) -1);
+
+	LVector<Plane> &planes = m_Pool.Get(pool_member);
+
+	for (int s=0; s<sc.m_iNumSplits; s++)
+	{
+		if (!m_SplitCamera.CreateSlice(m_MainCamera, distances[s], distances[s+1]))
+			continue;
+
+		planes.clear();
+		if (!m_SplitCamera.AddCameraLightPlanes(*this, source, planes))
+			continue;
+
+		for (int n=0; n<casters.size(); n++)
+		{
+			int sobID = casters[n];
+			const AABB &bb = m_SOBs[sobID].m_aabb;
+
+			bool bInside = true;
+			for (int p=0; p<planes.size(); p++)
+			{
+				float r_min, r_max;
+				bb.project_range_in_plane(planes[p], r_min, r_max);
+
+				if (r_min > 0.0f)
+				{
+					bInside = false;
+					break;
+				}
+			}
+
+			if (bInside)
+				sc.m_Casters[s].push_back(sobID);
+		}
+	}
+
+	// we no longer need these planes
+	m_Pool.Free(pool_member);
+}
+
+// A moving light that has not yet been retraced uses the casters from its last trace,
+// expanded by the casters within range in the room it is now in.
+// Returns false if the light can't cast into the view.
+bool LRoomManager::Light_AddCasters_Pending(int lightID)
+{
+	const LLight &light = m_Lights[lightID];
+
+	// reuse the light render scratch lists
+	LLightRender &lr = m_LightRender;
+	lr.m_BF_Temp_SOBs.Blank();
+	lr.m_Temp_Visible_SOBs.clear();
+	lr.m_BF_Temp_Visible_Rooms.Blank();
+	lr.m_Temp_Visible_Rooms.clear();
+
+	const LVector<int> &casters = m_LightScheduler.GetCasters(lightID);
+	for (int n=0; n<casters.size(); n++)
+	{
+		int sobID = casters[n];
+		lr.m_BF_Temp_SOBs.SetBit(sobID, true);
+		lr.m_Temp_Visible_SOBs.push_back(sobID);
+	}
+
+	// rooms from the last caster trace, and the rooms currently affected
+	const LVector<int> &rooms = m_LightScheduler.GetCasterRooms(lightID);
+	for (int n=0; n<rooms.size(); n++)
+	{
+		int r = rooms[n];
+		if (lr.m_BF_Temp_Visible_Rooms.CheckAndSet(r))
+			lr.m_Temp_Visible_Rooms.push_back(r);
+	}
+
+	for (int n=0; n<light.m_NumAffectedRooms; n++)
+	{
+		int r = light.m_AffectedRooms[n];
+		if (lr.m_BF_Temp_Visible_Rooms.CheckAndSet(r))
+			lr.m_Temp_Visible_Rooms.push_back(r);
+	}
+
+	const LRoom * pRoom = GetRoom(light.m_Source.m_RoomID);
+	if (pRoom)
+	{
+		const Vector3 &ptLight = light.m_Source.m_ptPos;
+		float range_sq = light.m_Source.m_fRange * light.m_Source.m_fRange;
+
+		int last_sob = pRoom->m_iFirstSOB + pRoom->m_iNumSOBs;
+		for (int n=pRoom->m_iFirstSOB; n<last_sob; n++)
+		{
+			if (lr.m_BF_Temp_SOBs.GetBit(n))
+				continue;
+
+			// distance from the light to the closest point on the bound
+			const AABB &bb = m_SOBs[n].m_aabb;
+			Vector3 ptMax = bb.position + bb.size;
+			Vector3 ptClosest;
+			ptClosest.x = CLAMP(ptLight.x, bb.position.x, ptMax.x);
+			ptClosest.y = CLAMP(ptLight.y, bb.position.y, ptMax.y);
+			ptClosest.z = CLAMP(ptLight.z, bb.position.z, ptMax.z);
+
+			if (ptLight.distance_squared_to(ptClosest) <= range_sq)
+			{
+				lr.m_BF_Temp_SOBs.SetBit(n, true);
+				lr.m_Temp_Visible_SOBs.push_back(n);
+			}
+		}
+	}
+
+	return Light_AddCasters_InView(lightID, lr.m_Temp_Visible_SOBs, lr.m_Temp_Visible_Rooms);
+}
+
+// the casters of a scheduled light are found for the whole reach of the light,
+// only those that can cast into the current view are added
+bool LRoomManager::Light_AddCasters_InView(int lightID, const LVector<int> &casters, const LVector<int> &lit_rooms)
+{
+	const LLight &light = m_Lights[lightID];
+
+	unsigned int pool_member = m_Pool.Request();
+	assert (pool_member != (unsigned int) -1);
+
+	LVector<Plane> &planes = m_Pool.Get(pool_member);
+	planes.clear();
+
+	if (!m_MainCamera.AddCameraLightPlanes(*this, light.m_Source, planes))
+	{
+		m_Pool.Free(pool_member);
+		return false;
+	}
+
+	LVector<int> &in_view = m_LightRender.m_Temp_InView_SOBs;
+	in_view.clear();
+
+	for (int n=0; n<casters.size(); n++)
+	{
+		int sobID = casters[n];
+		const AABB &bb = m_SOBs[sobID].m_aabb;
+
+		bool bInside = true;
+		for (int p=0; p<planes.size(); p++)
+		{
+			float r_min, r_max;
+			bb.project_range_in_plane(planes[p], r_min, r_max);
+
+			if (r_min > 0.0f)
+			{
+				bInside = false;
+				break;
+			}
+		}
+
+		if (bInside)
+			in_view.push_back(sobID);
+	}
+
+	m_Pool.Free(pool_member);
+
+	Light_AddCasters(lightID, in_view, lit_rooms);
 	return true;
 }
 
+bool LRoomManager::Light_UsesCasterCache(const LLight &light) const
+{
+	if (m_fCasterCacheMargin <= 0.0f)
+		return false;
+
+	// only non moving lights within rooms have a precalculated list of casters
+	return (!light.m_Source.IsGlobal()) && (light.m_Source.m_eClass == LSource::SC_STATIC);
+}
+
+// Make sure the cached casters for a static light are valid for the current camera.
+// The casters are found for an expanded camera volume, so remain a superset of the casters
+// for any camera frustum within that volume, and only need refreshing when the frustum leaves it.
+// Returns false if the cache could not be created.
+bool LRoomManager::Light_UpdateCasterCache(int lightID)
+{
+	const LLight &light = m_Lights[lightID];
+	LCasterCache &cache = m_CasterCaches[lightID];
+
+	if (cache.m_bValid && cache.m_Camera.ContainsFrustum(m_MainCamera))
+	{
+		m_iCasterCache_Hits++;
+		return true;
+	}
+
+	m_iCasterCache_Refreshes++;
+	cache.m_bValid = false;
+	cache.m_Casters.clear();
+	cache.m_Rooms.clear();
+
+	if (!cache.m_Camera.CreateExpanded(m_MainCamera, m_fCasterCacheMargin))
+		return false;
+
+	unsigned int pool_member = m_Pool.Request();
+	if (pool_member == (unsigned int) -1)
+		return false;
+
+	LVector<Plane> &planes = m_Pool.Get(pool_member);
+	planes.clear();
+
+	cache.m_bValid = true;
+	cache.m_bInView = cache.m_Camera.AddCameraLightPlanes(*this, light.m_Source, planes);
+
+	if (cache.m_bInView)
+	{
+		// rather than a portal trace, clip the casters precalculated on conversion
+		int last_caster = light.m_FirstCaster + light.m_NumCasters;
+		for (int c=light.m_FirstCaster; c<last_caster; c++)
+		{
+			int sobID = m_LightCasters_SOB[c];
+			const AABB &bb = m_SOBs[sobID].m_aabb;
+
+			bool bInside = true;
+			for (int p=0; p<planes.size(); p++)
+			{
+				float r_min, r_max;
+				bb.project_range_in_plane(planes[p], r_min, r_max);
+
+				if (r_min > 0.0f)
+				{
+					bInside = false;
+					break;
+				}
+			}
+
+			if (bInside)
+				cache.m_Casters.push_back(sobID);
+		}
+
+		// the affected rooms list may have been truncated, in which case any room may be lit
+		if (light.m_NumAffectedRooms < LLight::MAX_AFFECTED_ROOMS)
+		{
+			for (int r=0; r<light.m_NumAffectedRooms; r++)
+				cache.m_Rooms.push_back(light.m_AffectedRooms[r]);
+		}
+		else
+		{
+			for (int r=0; r<m_Rooms.size(); r++)
+				cache.m_Rooms.push_back(r);
+		}
+	}
+
+	m_Pool.Free(pool_member);
+
+	return true;
+}
+
+void LRoomManager::CasterCache_Reset()
+{
+	m_CasterCaches.resize(m_Lights.size());
+
+	for (int n=0; n<m_CasterCaches.size(); n++)
+		m_CasterCaches[n].m_bValid = false;
+}
+
 void LRoomManager::Light_UpdateTransform(LLight &light, const Light &glight) const
 {
 	if (!glight.get_parent())
@@ -804,11 +1530,13 @@ void LRoomManager::Light_UpdateTransform(LLight &light, const Light &glight) con
 }
 
 // common stuff for global and local light creation
-bool LRoomManager::LightCreate(Light * pLight, int roomID, String szArea)
+bool LRoomManager::LightCreate(Light * pLight, int roomID, String szArea, bool bSetCullMask)
 {
 	// set culling flag for light
 	// 1 is for lighting objects outside the room system
-	pLight->set_cull_mask(1 | LRoom::LAYER_MASK_LIGHT);
+	// (async conversion sets it later, on the main thread)
+	if (bSetCullMask)
+		pLight->set_cull_mask(1 | LRoom::LAYER_MASK_LIGHT);
 
 	// create new light
 	LLight l;
@@ -915,6 +1643,116 @@ int LRoomManager::dynamic_light_register(Node * pLightNode, float radius)
 }
 
 
+void LRoomManager::rooms_set_shadow_receiver_culling(bool bActive)
+{
+	m_bShadowReceiverCulling = bActive;
+}
+
+void LRoomManager::rooms_set_light_layers(bool bActive)
+{
+	if (bActive == m_bLightLayers)
+		return;
+
+	if (m_pAsyncConvert)
+	{
+		WARN_PRINT_ONCE("rooms_set_light_layers : converting");
+		return;
+	}
+
+	m_bLightLayers = bActive;
+
+	// back to the shared light bit, the sobs lose their light layer bits on the next soft show
+	if (!bActive)
+	{
+		for (int n=0; n<m_Lights.size(); n++)
+		{
+			Light * pLight = m_Lights[n].GetGodotLight();
+			if (pLight)
+				pLight->set_cull_mask(1 | LRoom::LAYER_MASK_LIGHT);
+		}
+	}
+
+	m_LightLayers.Reset();
+}
+
+void LRoomManager::rooms_set_directional_split_culling(bool bActive)
+{
+	m_bDirectionalSplits = bActive;
+}
+
+Array LRoomManager::rooms_get_directional_split_casters(Node * pLightNode, int split) const
+{
+	Array casters;
+	CHECK_NOT_CONVERTING("rooms_get_directional_split_casters", casters)
+
+	if (!pLightNode)
+		return casters;
+
+	// find the registered light
+	ObjectID godot_id = pLightNode->get_instance_id();
+	int light_id = -1;
+	for (int n=0; n<m_Lights.size(); n++)
+	{
+		if (m_Lights[n].m_GodotID == godot_id)
+		{
+			light_id = n;
+			break;
+		}
+	}
+
+	// only valid for lights processed on the last frame
+	if ((light_id == -1) || (light_id >= m_SplitCasters.size()))
+		return casters;
+
+	const LSplitCasters &sc = m_SplitCasters[light_id];
+	if ((sc.m_uiFrame != m_uiFrameCounter) || (split < 0) || (split >= sc.m_iNumSplits))
+		return casters;
+
+	const LVector<int> &list = sc.m_Casters[split];
+	for (int n=0; n<list.size(); n++)
+	{
+		Spatial * pS = m_SOBs[list[n]].GetSpatial();
+		if (pS)
+			casters.push_back(pS);
+	}
+
+	return casters;
+}
+
+void LRoomManager::rooms_set_light_update_budget(int budget_usec)
+{
+	// any lights still pending will be retraced on the next frame
+	m_LightScheduler.SetBudget(budget_usec);
+}
+
+void LRoomManager::rooms_set_light_budget(int max_active, int max_shadowed)
+{
+	if (m_pAsyncConvert)
+	{
+		WARN_PRINT_ONCE("rooms_set_light_budget : converting");
+		return;
+	}
+
+	m_LightBudget.SetBudget(max_active, max_shadowed);
+
+	// give back any shadows that were turned off
+	if (!m_LightBudget.IsActive())
+		m_LightBudget.Restore(*this);
+}
+
+void LRoomManager::rooms_set_static_light_cache_margin(float margin)
+{
+	if (m_pAsyncConvert)
+	{
+		WARN_PRINT_ONCE("rooms_set_static_light_cache_margin : converting");
+		return;
+	}
+
+	m_fCasterCacheMargin = margin;
+	CasterCache_Reset();
+}
+
+
 bool LRoomManager::dynamic_light_unregister(int light_id)
 {
 	// NYI
@@ -924,6 +1762,8 @@ bool LRoomManager::dynamic_light_unregister(int light_id)
 // returns room within or -1 if no dob
 int LRoomManager::dynamic_light_update(int light_id, const Vector3 &pos, const Vector3 &dir) // returns room within
 {
+	CHECK_NOT_CONVERTING("dynamic_light_update", -1)
+
 	// doesn't now matter if not in tree as position and dir are passed directly
 	if ((unsigned int) light_id >= (unsigned int) m_Lights.size())
 	{
@@ -950,34 +1790,32 @@ int LRoomManager::dynamic_light_update(int light_id, const Vector3 &pos, const V
 		light.m_Source.m_RoomID = iNewRoom;
 	}
 
-	// update with a new Trace (we are assuming update is only called if the light has moved)
-	// remove the old local lights
-	for (int n=0; n<light.m_NumAffectedRooms; n++)
-	{
-		int r = light.m_AffectedRooms[n];
-		GetRoom(r)->RemoveLocalLight(light_id);
-	}
-	light.ClearAffectedRooms();
-
+	// the affected rooms can't have changed
+	if (!Light_NeedsRetrace(light))
+		return Room_ToUser(light.m_Source.m_RoomID);
 
-	// now do a new trace, and add all the rooms that are hit
-	m_Trace.Trace_Light(*this, light, LTrace::LR_ROOMS);
-
-	// we should now have a list of the rooms hit in m_LightRender.m_Temp_Visible_Rooms
-	for (int n=0; n<m_LightRender.m_Temp_Visible_Rooms.size(); n++)
+	if (m_LightScheduler.IsActive())
 	{
-		int r = m_LightRender.m_Temp_Visible_Rooms[n];
-
-		// add to the list on the light
-		light.AddAffectedRoom(r);
-
-		// add to the list of local lights in the room
-		GetRoom(r)->AddLocalLight(light_id);
+		// until the light is retraced, make sure it at least affects the room it is now in
+		int r = light.m_Source.m_RoomID;
+		LRoom * pRoom = GetRoom(r);
+		if (pRoom && (pRoom->m_LocalLights.find(light_id) == -1))
+		{
+			if (light.AddAffectedRoom(r))
+				pRoom->AddLocalLight(light_id);
+		}
 
+		m_LightScheduler.Reset(m_Lights.size());
+		m_LightScheduler.Request(light_id, m_uiFrameCounter);
+	}
+	else
+	{
+		// update with a new Trace (we are assuming update is only called if the light has moved)
+		Light_RetraceAffectedRooms(light_id);
 	}
 
 	// this may or may not have changed
-	return light.m_Source.m_RoomID;
+	return Room_ToUser(light.m_Source.m_RoomID);
 
 	/*
 	if (!pLightNode)
@@ -1074,6 +1912,127 @@ int LRoomManager::dynamic_light_update(int light_id, const Vector3 &pos, const V
 	return 0;
 }
 
+// Moving a light only changes the rooms it reaches once it has moved far enough to see through a portal
+// differently. Moves that are small relative to the distance to the nearest portal of the room are not retraced.
+bool LRoomManager::Light_NeedsRetrace(const LLight &light) const
+{
+	if (!light.m_bTraced)
+		return true;
+
+	const LSource &source = light.m_Source;
+	if (source.m_RoomID != light.m_iTracedRoomID)
+		return true;
+
+	if (source.m_fRange != light.m_fTracedRange)
+		return true;
+
+	// the range could reach a portal at one of the positions
+	float slack = light.m_fTracedSlack;
+	if (slack <= 0.0f)
+		return true;
+
+	return source.m_ptPos.distance_squared_to(light.m_ptTracedPos) >= (slack * slack);
+}
+
+void LRoomManager::Light_StoreTraced(LLight &light) const
+{
+	const LSource &source = light.m_Source;
+
+	light.m_bTraced = true;
+	light.m_iTracedRoomID = source.m_RoomID;
+	light.m_ptTracedPos = source.m_ptPos;
+	light.m_fTracedRange = source.m_fRange;
+
+	// While the range sphere can't reach any portal of the room, the light can only affect its own room
+	// whatever its position and direction, so the trace can't change. The slack is how far the light can
+	// move before the sphere could touch a portal (the distances to the plane and to the portal bounding
+	// sphere change by at most the distance moved). A room with no portals can't light any other rooms.
+	float slack = FLT_MAX;
+	float range = source.m_fRange;
+
+	const LRoom * pRoom = GetRoom(source.m_RoomID);
+	if (pRoom)
+	{
+		for (int p=0; p<pRoom->m_iNumPortals; p++)
+		{
+			const LPortal &port = m_Portals[pRoom->m_iFirstPortal + p];
+
+			float radius = 0.0f;
+			for (int n=0; n<port.m_ptsWorld.size(); n++)
+				radius = MAX(radius, port.m_ptsWorld[n].distance_to(port.m_ptCentre));
+
+			float clear_plane = Math::abs(port.m_Plane.distance_to(source.m_ptPos)) - range;
+			float clear_portal = source.m_ptPos.distance_to(port.m_ptCentre) - radius - range;
+			slack = MIN(slack, MAX(clear_plane, clear_portal));
+		}
+	}
+	else
+		slack = 0.0f;
+
+	light.m_fTracedSlack = slack;
+}
+
+// only the rooms that have been added or removed since the last trace have their light lists changed
+void LRoomManager::Light_RetraceAffectedRooms(int lightID)
+{
+	LLight &light = m_Lights[lightID];
+
+	// now do a new trace, the rooms that are hit are in m_LightRender.m_Temp_Visible_Rooms
+	// and m_LightRender.m_BF_Temp_Visible_Rooms
+	m_Trace.Trace_Light(*this, light, LTrace::LR_ROOMS);
+	Light_StoreTraced(light);
+
+	const LVector<int> &new_rooms = m_LightRender.m_Temp_Visible_Rooms;
+	const Lawn::LBitField_Dynamic &BF_new_rooms = m_LightRender.m_BF_Temp_Visible_Rooms;
+
+	// rooms beyond the affected room limit were never recorded, so may already have the light
+	bool bOverflowed = light.m_NumAffectedRooms >= LLight::MAX_AFFECTED_ROOMS;
+
+	// remove the light from rooms it no longer reaches, keeping the rest
+	int nKept = 0;
+	for (int n=0; n<light.m_NumAffectedRooms; n++)
+	{
+		int r = light.m_AffectedRooms[n];
+
+		if (BF_new_rooms.GetBit(r))
+			light.m_AffectedRooms[nKept++] = r;
+		else
+			GetRoom(r)->RemoveLocalLight(lightID);
+	}
+	int nOld = nKept;
+	light.m_NumAffectedRooms = nKept;
+
+	// add the light to the rooms it now reaches
+	for (int n=0; n<new_rooms.size(); n++)
+	{
+		int r = new_rooms[n];
+
+		// already affected (the old list is small)
+		bool bFound = false;
+		for (int o=0; o<nOld; o++)
+		{
+			if (light.m_AffectedRooms[o] == r)
+			{
+				bFound = true;
+				break;
+			}
+		}
+
+		if (bFound)
+			continue;
+
+		// add to the list on the light
+		light.AddAffectedRoom(r);
+
+		// add to the list of local lights in the room
+		LRoom * pRoom = GetRoom(r);
+		if (bOverflowed && (pRoom->m_LocalLights.find(lightID) != -1))
+			continue;
+
+		pRoom->AddLocalLight(lightID);
+	}
+}
+
 void LRoomManager::DebugString_Light_AffectedRooms(int light_id)
 {
 #ifdef LDEBUG_LIGHT_AFFECTED_ROOMS
@@ -1099,6 +2058,7 @@ void LRoomManager::DebugString_Light_AffectedRooms(int light_id)
 bool LRoomManager::global_light_register(Node * pLightNode, String szArea)
 {
 	//CHECK_ROOM_LIST
+	CHECK_NOT_CONVERTING("light_register", false)
 
 	if (!pLightNode)
 	{
@@ -1155,20 +2115,48 @@ void LRoomManager::DobUpdateVisibility(int dob_id)
 }
 */
 
+bool LRoomManager::dob_set_auto_update(int dob_id, bool bAuto)
+{
+	CHECK_NOT_CONVERTING("dob_set_auto_update", false)
+
+	int slot = m_DobList.FindSlot(dob_id);
+	if (slot == -1)
+	{
+		WARN_PRINT_ONCE("dob_set_auto_update : invalid dob_id (unregistered?)");
+		return false;
+	}
+
+	m_DobList.SetAutoUpdate(slot, bAuto);
+	return true;
+}
+
 int LRoomManager::dob_get_room_id(int dob_id)
 {
-	return m_DobList.GetDob(dob_id).m_iRoomID;
+	CHECK_NOT_CONVERTING("dob_get_room_id", -1)
+
+	int slot = m_DobList.FindSlot(dob_id);
+	if (slot == -1)
+		return -1;
+
+	return Room_ToUser(m_DobList.GetDob(slot).m_iRoomID);
 }
 
 // helpers to enable the client to manage switching on and off physics and AI
 int LRoomManager::rooms_get_num_rooms() const
 {
+	CHECK_NOT_CONVERTING("rooms_get_num_rooms", 0)
+
+	if (m_UserRooms.size())
+		return m_UserRooms.size();
+
 	return m_Rooms.size();
 }
 
 Vector3 LRoomManager::rooms_get_room_centre(int room_id) const
 {
-	const LRoom * pRoom = GetRoom(room_id);
+	CHECK_NOT_CONVERTING("rooms_get_room_centre", Vector3(0, 0, 0))
+
+	const LRoom * pRoom = GetRoom(Room_FromUser(room_id));
 
 	if (!pRoom)
 		return Vector3(0, 0, 0);
@@ -1179,7 +2167,10 @@ Vector3 LRoomManager::rooms_get_room_centre(int room_id) const
 
 bool LRoomManager::rooms_is_room_visible(int room_id) const
 {
-	if (room_id >= m_Rooms.size())
+	CHECK_NOT_CONVERTING("rooms_is_room_visible", false)
+
+	room_id = Room_FromUser(room_id);
+	if ((unsigned int) room_id >= (unsigned int) m_Rooms.size())
 	{
 		LWARN(5, "LRoomManager::rooms_is_room_visible : room id higher than number of rooms");
 		return false;
@@ -1191,9 +2182,26 @@ bool LRoomManager::rooms_is_room_visible(int room_id) const
 Array LRoomManager::rooms_get_visible_rooms() const
 {
 	Array rooms;
+	CHECK_NOT_CONVERTING("rooms_get_visible_rooms", rooms)
+
 	for (int n=0; n<m_pCurr_VisibleRoomList->size(); n++)
 	{
-		rooms.push_back((*m_pCurr_VisibleRoomList)[n]);
+		Room_AddUsers((*m_pCurr_VisibleRoomList)[n], rooms);
+	}
+
+	return rooms;
+}
+
+
+Array LRoomManager::rooms_find_rooms_in_aabb(const AABB &bb)
+{
+	Array rooms;
+	CHECK_NOT_CONVERTING("rooms_find_rooms_in_aabb", rooms)
+
+	m_RoomGrid.FindRooms(*this, bb, m_RoomGrid_Temp);
+	for (int n=0; n<m_RoomGrid_Temp.size(); n++)
+	{
+		Room_AddUsers(m_RoomGrid_Temp[n], rooms);
 	}
 
 	return rooms;
@@ -1202,6 +2210,20 @@ Array LRoomManager::rooms_get_visible_rooms() const
 
 Node * LRoomManager::rooms_get_room(int room_id)
 {
+	CHECK_NOT_CONVERTING("rooms_get_room", NULL)
+
+	// each of the merged rooms has its own node
+	if (m_UserRooms.size())
+	{
+		if ((unsigned int) room_id >= (unsigned int) m_UserRooms.size())
+		{
+			WARN_PRINT_ONCE("rooms_get_room : room id out of range");
+			return NULL;
+		}
+
+		return Object::cast_to<Node>(ObjectDB::get_instance(m_UserRooms[room_id].m_GodotID));
+	}
+
 	const LRoom * pRoom = GetRoom(room_id);
 
 	if (!pRoom)
@@ -1241,6 +2263,12 @@ void LRoomManager::rooms_set_active(bool bActive)
 		return;
 	}
 
+	if (m_pAsyncConvert)
+	{
+		WARN_PRINT_ONCE("rooms_set_active : converting");
+		return;
+	}
+
 	CheckRoomList();
 
 	m_bActive = bActive;
@@ -1300,6 +2328,25 @@ void LRoomManager::rooms_set_active(bool bActive)
 
 	m_BF_ActiveLights_prev.Blank();
 	m_BF_ActiveLights.Blank();
+
+	// DOBS
+	// show all, they will be culled again from the next frame
+	for (int n=0; n<m_DobList.GetNumDobs(); n++)
+	{
+		LDob &dob = m_DobList.GetDob(n);
+		if (!dob.m_bSlotTaken)
+			continue;
+
+		dob.Show(true);
+		dob.SetLayerMask(LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT);
+		if (bActive)
+			m_VisibleList_DOBs.push_back(n);
+	}
+
+	m_CasterList_DOBs.clear();
+
+	if (!bActive)
+		m_VisibleList_DOBs.clear();
 }
 
 String LRoomManager::rooms_get_debug_frame_string()
@@ -1325,6 +2372,14 @@ bool LRoomManager::rooms_set_camera(int dob_id, Node * pCam)
 {
 	CHECK_ROOM_LIST
 
+	// internally the camera is stored by slot
+	int slot = m_DobList.FindSlot(dob_id);
+	if (slot == -1)
+	{
+		WARN_PRINT("rooms_set_camera : invalid dob_id");
+		return false;
+	}
+
 	// is it the first setting of the camera? if so hide all
 	if (m_DOB_id_camera == -1)
 		ShowAll(false);
@@ -1344,9 +2399,14 @@ bool LRoomManager::rooms_set_camera(int dob_id, Node * pCam)
 //	int id = pCam->get_instance_id();
 
 	// was this a change in camera?
-	if (m_DOB_id_camera != dob_id)
+	if (m_DOB_id_camera != slot)
 	{
-		m_DOB_id_camera = dob_id;
+		m_DOB_id_camera = slot;
+
+		// the camera is never culled
+		LDob &dob = m_DobList.GetDob(slot);
+		dob.Show(true);
+		dob.SetLayerMask(LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT);
 		//m_ID_camera = id;
 
 		// make sure the camera room is correct by doing a teleport
@@ -1367,20 +2427,271 @@ bool LRoomManager::rooms_set_camera(int dob_id, Node * pCam)
 // convert empties and meshes to rooms and portals
 bool LRoomManager::RoomsConvert(bool bVerbose, bool bDeleteLights, bool bSingleRoomMode)
 {
+	ConvertAsync_Finish();
 	ResolveRoomListPath();
 	CHECK_ROOM_LIST
 
+	// the scene must be hashed before conversion changes it
+	LConvertCache cache;
+	if (m_szConvertCache != "")
+	{
+		cache.HashScene(*this, bDeleteLights, bSingleRoomMode);
+		if (cache.Load(*this, m_szConvertCache))
+			return true;
+	}
+
 	LRoomConverter conv;
 	conv.Convert(*this, bVerbose, false, bDeleteLights, bSingleRoomMode);
+
+	if (m_szConvertCache != "")
+		cache.Save(*this, m_szConvertCache, conv.GetDeletedNodes());
+
+	return true;
+}
+
+bool LRoomManager::rooms_convert_async(bool bVerbose, bool bDeleteLights)
+{
+	if (m_pAsyncConvert)
+	{
+		WARN_PRINT_ONCE("rooms_convert_async : already converting");
+		return false;
+	}
+
+	ResolveRoomListPath();
+	CHECK_ROOM_LIST
+
+	// the scene must be hashed before conversion changes it
+	if (m_szConvertCache != "")
+	{
+		LConvertCache * pCache = memnew(LConvertCache);
+		pCache->HashScene(*this, bDeleteLights, false);
+
+		// loading is quick, but the finished signal is still sent on the next frame
+		if (pCache->Load(*this, m_szConvertCache))
+		{
+			memdelete(pCache);
+			call_deferred("emit_signal", "conversion_finished");
+			return true;
+		}
+
+		m_pAsyncCache = pCache;
+	}
+
+	m_fAsyncProgress = 0.0f;
+	m_pAsyncConvert = memnew(LRoomConverter);
+	m_pAsyncConvert->Async_Begin(*this, bVerbose, bDeleteLights);
 	return true;
 }
 
+void LRoomManager::ConvertAsync_Update()
+{
+	float progress = m_pAsyncConvert->Async_GetProgress();
+	if (progress != m_fAsyncProgress)
+	{
+		m_fAsyncProgress = progress;
+		emit_signal("conversion_progress", progress);
+	}
+
+	if (m_pAsyncConvert->Async_IsDone())
+		ConvertAsync_Finish();
+}
+
+// waits for the conversion thread if necessary, then makes the changes to the scene
+void LRoomManager::ConvertAsync_Finish()
+{
+	if (!m_pAsyncConvert)
+		return;
+
+	LRoomConverter * pConv = m_pAsyncConvert;
+	m_pAsyncConvert = 0;
+	pConv->Async_End();
+
+	if (m_pAsyncCache)
+	{
+		m_pAsyncCache->Save(*this, m_szConvertCache, pConv->GetDeletedNodes());
+		memdelete(m_pAsyncCache);
+		m_pAsyncCache = 0;
+	}
+
+	memdelete(pConv);
+	emit_signal("conversion_finished");
+}
+
+void LRoomManager::rooms_set_convert_cache(String szFilename)
+{
+	m_szConvertCache = szFilename;
+}
+
 bool LRoomManager::rooms_single_room_convert(bool bVerbose, bool bDeleteLights)
 {
 	return RoomsConvert(bVerbose, bDeleteLights, true);
 }
 
 
+bool LRoomManager::rooms_unload_area(String szArea)
+{
+	CHECK_ROOM_LIST
+
+	int area_id = Area_Find(szArea);
+	if (area_id == -1)
+	{
+		WARN_PRINT_ONCE("rooms_unload_area : area not found");
+		return false;
+	}
+
+	const LArea &area = m_Areas[area_id];
+	int first_room = area.m_iChunk_FirstRoom;
+	int last_room = first_room + area.m_iChunk_NumRooms;
+
+	for (int r=first_room; r<last_room; r++)
+	{
+		LRoom &lroom = m_Rooms[r];
+		if (!lroom.m_bLoaded)
+			continue;
+
+		lroom.m_bLoaded = false;
+
+		// let go of the godot nodes, detached objects are reattached so they are freed with the area
+		int last_sob = lroom.m_iFirstSOB + lroom.m_iNumSOBs;
+		for (int n=lroom.m_iFirstSOB; n<last_sob; n++)
+		{
+			LSob &sob = m_SOBs[n];
+			sob.Show(true);
+			sob.Hidable_Release();
+			sob.m_ID = 0;
+		}
+	}
+
+	// room lights
+	for (int n=0; n<m_Lights.size(); n++)
+	{
+		LLight &light = m_Lights[n];
+		if (!light.m_pNode || light.m_Source.IsGlobal())
+			continue;
+
+		int room_id = light.m_Source.m_RoomID;
+		if ((room_id < first_room) || (room_id >= last_room))
+			continue;
+
+		// the budget and light layers refer to the node until it is released
+		m_LightBudget.Light_Release(*this, n);
+		m_LightLayers.Light_Reset(n);
+
+		light.Show(true);
+		light.Hidable_Release();
+		light.m_GodotID = 0;
+	}
+
+	return true;
+}
+
+bool LRoomManager::rooms_load_area(String szArea, Node * pAreaNode)
+{
+	CHECK_ROOM_LIST
+
+	if (!pAreaNode)
+	{
+		WARN_PRINT_ONCE("rooms_load_area : pAreaNode is NULL");
+		return false;
+	}
+
+	int area_id = Area_Find(szArea);
+	if (area_id == -1)
+	{
+		WARN_PRINT_ONCE("rooms_load_area : area not found");
+		return false;
+	}
+
+	LRoomConverter conv;
+	return conv.Reload_Area(*this, area_id, pAreaNode);
+}
+
+bool LRoomManager::rooms_is_room_loaded(int room_id) const
+{
+	CHECK_NOT_CONVERTING("rooms_is_room_loaded", false)
+
+	const LRoom * pRoom = GetRoom(Room_FromUser(room_id));
+	if (!pRoom)
+		return false;
+
+	return pRoom->m_bLoaded;
+}
+
+bool LRoomManager::rooms_reconvert_room(Node * pRoomNode)
+{
+	CHECK_ROOM_LIST
+
+	Spatial * pGRoom = Object::cast_to<Spatial>(pRoomNode);
+	if (!pGRoom)
+	{
+		WARN_PRINT_ONCE("rooms_reconvert_room : room node is not a Spatial");
+		return false;
+	}
+
+	int room_id = Room_FindByNode(pGRoom);
+	if (room_id == -1)
+	{
+		WARN_PRINT_ONCE("rooms_reconvert_room : room not found");
+		return false;
+	}
+
+	LRoom &lroom = m_Rooms[room_id];
+	if (!lroom.m_bLoaded)
+	{
+		WARN_PRINT_ONCE("rooms_reconvert_room : room is not loaded");
+		return false;
+	}
+
+	// the room nodes can't be told apart once merged
+	if (Room_IsMerged(room_id))
+	{
+		WARN_PRINT_ONCE("rooms_reconvert_room : room was merged on conversion, use rooms_convert");
+		return false;
+	}
+
+	// objects removed from the room may already have been freed
+	int last_sob = lroom.m_iFirstSOB + lroom.m_iNumSOBs;
+	for (int n=lroom.m_iFirstSOB; n<last_sob; n++)
+	{
+		LSob &sob = m_SOBs[n];
+		if (!ObjectDB::get_instance(sob.m_ID))
+		{
+			sob.Hidable_Release();
+			sob.m_ID = 0;
+		}
+	}
+
+	lroom.m_GodotID = pGRoom->get_instance_id();
+	if (m_UserRooms.size())
+		m_UserRooms[Room_ToUser(room_id)].m_GodotID = lroom.m_GodotID;
+
+	// everything is shown as before conversion while the room is converted
+	bool bActive = m_bActive;
+	if (bActive)
+		rooms_set_active(false);
+
+	LRoomConverter conv;
+	bool bOK = conv.Reconvert_Room(*this, room_id, pGRoom);
+
+	// anything kept between frames that depends on the sobs and light traces
+	CasterCache_Reset();
+	m_LightScheduler.Reset(0);
+	m_LightScheduler.Reset(m_Lights.size());
+	m_LightLayers.Reset();
+	m_SunGrids.clear(true);
+	m_SplitCasters.clear(true);
+
+	m_MasterList_SOBs.clear();
+	m_MasterList_SOBs_prev.clear();
+	m_VisibleList_SOBs.clear();
+	m_CasterList_SOBs.clear();
+
+	if (bActive)
+		rooms_set_active(true);
+
+	return bOK;
+}
+
 void LRoomManager::rooms_set_hide_method_detach(bool bDetach)
 {
 	LHidable::m_bDetach = bDetach;
@@ -1392,6 +2703,22 @@ void LRoomManager::rooms_set_portal_plane_convention(bool bFlip)
 	m_bPortalPlane_Convention = bFlip;
 }
 
+void LRoomManager::rooms_set_portal_max_verts(int max_verts)
+{
+	m_iPortalMaxVerts = MAX(max_verts, 0);
+}
+
+void LRoomManager::rooms_set_bound_max_planes(int max_planes)
+{
+	m_iBoundMaxPlanes = MAX(max_planes, 0);
+}
+
+void LRoomManager::rooms_set_graph_optimization(bool bActive, int merge_max_objects)
+{
+	m_bGraphOptimization = bActive;
+	m_iMergeMaxObjects = MAX(merge_max_objects, 0);
+}
+
 // convert empties and meshes to rooms and portals
 bool LRoomManager::rooms_convert(bool bVerbose, bool bDeleteLights)
 {
@@ -1420,6 +2747,7 @@ bool LRoomManager::rooms_save_scene(Node * pNode, String szFilename)
 // free memory for current set of rooms, prepare for converting a new game level
 void LRoomManager::rooms_release()
 {
+	ConvertAsync_Finish();
 	CheckRoomList();
 
 	// unhide all the objects and reattach to scene graph
@@ -1461,15 +2789,32 @@ void LRoomManager::ReleaseResources(bool bPrepareConvert)
 	m_Areas.clear(true);
 	m_SOBs.clear();
 
+	m_UserRooms.clear(true);
+	m_RoomUsers_First.clear();
+	m_RoomUsers.clear();
+
 	m_AreaLights.clear(true);
 	m_AreaRooms.clear(true);
 
+	// before the lights are gone
+	m_LightBudget.Restore(*this);
+
 	if (!bPrepareConvert)
 		m_Lights.clear();
 
 	m_ActiveLights.clear();
 	m_ActiveLights_prev.clear();
 
+	// force the static light caches to be recreated
+	m_CasterCaches.clear();
+	m_LightScheduler.Reset(0);
+	m_LightLayers.Reset();
+
+	// the area sobs may change on reconversion
+	m_SunGrids.clear(true);
+	m_RoomGrid.Clear();
+	m_SplitCasters.clear(true);
+
 	m_VisibleRoomList_A.clear();
 	m_VisibleRoomList_B.clear();
 
@@ -1515,6 +2860,24 @@ void LRoomManager::FrameUpdate_Prepare()
 	m_BF_caster_SOBs.Blank();
 	m_BF_visible_SOBs.Blank();
 
+	// dobs
+	m_VisibleList_DOBs_prev.copy_from(m_VisibleList_DOBs);
+	m_VisibleList_DOBs.clear();
+
+	// dobs can be registered at any time
+	if (m_BF_visible_DOBs.GetNumBits() != (unsigned int) m_DobList.GetNumDobs())
+		m_BF_visible_DOBs.Create(m_DobList.GetNumDobs());
+	else
+		m_BF_visible_DOBs.Blank();
+
+	m_CasterList_DOBs_prev.copy_from(m_CasterList_DOBs);
+	m_CasterList_DOBs.clear();
+
+	if (m_BF_caster_DOBs.GetNumBits() != (unsigned int) m_DobList.GetNumDobs())
+		m_BF_caster_DOBs.Create(m_DobList.GetNumDobs());
+	else
+		m_BF_caster_DOBs.Blank();
+
 	// lights
 	m_BF_ActiveLights_prev.CopyFrom(m_BF_ActiveLights);
 	m_ActiveLights_prev.copy_from(m_ActiveLights);
@@ -1522,6 +2885,17 @@ void LRoomManager::FrameUpdate_Prepare()
 	m_BF_ActiveLights.Blank();
 	m_BF_ProcessedLights.Blank();
 
+	// lights may have been added or reconverted
+	if (m_CasterCaches.size() != m_Lights.size())
+		CasterCache_Reset();
+
+	m_iCasterCache_Hits = 0;
+	m_iCasterCache_Refreshes = 0;
+	m_iSunGrid_Tested = 0;
+
+	if (m_bLightLayers)
+		m_LightLayers.Prepare(m_Lights.size(), m_SOBs.size());
+
 	// as we hit visible rooms we will mark them in a bitset, so we can hide any rooms
 	// that are showing that haven't been hit this frame
 	m_BF_visible_rooms.Blank();
@@ -1544,11 +2918,13 @@ bool LRoomManager::FrameUpdate()
 	if (!m_bActive)
 		return false;
 
+	// nothing to show until a background conversion has finished
+	if (m_pAsyncConvert)
+		return false;
+
 	CHECK_ROOM_LIST
 
-#ifdef LPORTAL_DOBS_AUTO_UPDATE
 	DobsAutoUpdate();
-#endif
 
 
 	if (m_bFrustumOnly)
@@ -1586,7 +2962,7 @@ bool LRoomManager::FrameUpdate()
 	// always doing dob update here for camera, this ensures it is not one frame behind
 	// depending on scene tree, which can cause camera lroom id to be the old one after crossing
 	// a portal plane, causing a flicker on changing room...
-	dob_update(m_DOB_id_camera, pCamera->get_global_transform().origin);
+	m_DobList.UpdateDob(*this, m_DOB_id_camera, pCamera->get_global_transform().origin);
 
 	//dob_update(pCamera);
 
@@ -1621,6 +2997,13 @@ bool LRoomManager::FrameUpdate()
 	if (!m_MainCamera.Prepare(*this, pCamera))
 		return false;
 
+	// the camera trace will record the regions of the rooms that can receive shadows
+	m_Receivers.Prepare(m_Rooms.size(), m_MainCamera, cam.m_ptPos);
+
+	// retrace the most important of the dynamic lights that have moved
+	m_LightScheduler.Reset(m_Lights.size());
+	m_LightScheduler.Process(*this, cam.m_ptPos);
+
 	// the first set of planes are allocated and filled with the view frustum planes
 	// Note that the visual server doesn't actually need to do view frustum culling as a result...
 	// (but is still doing it for now)
@@ -1636,6 +3019,9 @@ bool LRoomManager::FrameUpdate()
 	// the whole visibility algorithm is recursive, spreading out from the camera room,
 	// rendering through any portals in view into other rooms, etc etc
 	m_Trace.Trace_Prepare(*this, cam, m_BF_visible_SOBs, m_BF_visible_rooms, m_VisibleList_SOBs, *m_pCurr_VisibleRoomList);
+	if (!m_bShadowReceiverCulling)
+		m_Trace.Trace_SetFlags(m_Trace.Trace_GetFlags() & ~LTrace::FIND_RECEIVERS);
+
 	m_Trace.Trace_Begin(*pRoom, planes);
 
 	// we no longer need these planes
@@ -1653,6 +3039,8 @@ bool LRoomManager::FrameUpdate()
 
 	FrameUpdate_FinalizeVisibility_SoftShow();
 
+	FrameUpdate_FinalizeVisibility_DOBs();
+
 	// swap the current and previous visible room list
 	LVector<int> * pTemp = m_pCurr_VisibleRoomList;
 	m_pCurr_VisibleRoomList = m_pPrev_VisibleRoomList;
@@ -1733,14 +3121,96 @@ void LRoomManager::FrameUpdate_AddShadowCasters()
 		m_Rooms[r].AddShadowCasters(*this);
 	}
 
+	// drop the least important lights over the budget, before they are given layers
+	if (m_LightBudget.IsActive())
+		m_LightBudget.Apply(*this, m_MainCamera.m_ptPos);
+
+	// now all the casters are known, the lights can be given layers
+	if (m_bLightLayers)
+		m_LightLayers.Assign(m_ActiveLights);
+
 #ifdef LDEBUG_LIGHTS
 	if (m_bDebugFrameString)
 		DebugString_Add("TOTAL shadow casters " + itos(m_CasterList_SOBs.size()) + "\n");
+
+	if (m_bDebugFrameString && m_bShadowReceiverCulling)
+		DebugString_Add("Receivers " + itos(m_Receivers.GetNumReceivers()) + ", receiver culled casters " + itos(m_Receivers.m_iNumCulled) + "\n");
+
+	if (m_bDebugFrameString && (m_fCasterCacheMargin > 0.0f))
+		DebugString_Add("Static light cache hits " + itos(m_iCasterCache_Hits) + ", refreshes " + itos(m_iCasterCache_Refreshes) + "\n");
+
+	if (m_bDebugFrameString && m_LightScheduler.IsActive())
+		DebugString_Add("Light retraces " + itos(m_LightScheduler.m_iNumProcessed) + " (" + itos(m_LightScheduler.m_iTime_usec) + " usec), pending " + itos(m_LightScheduler.GetNumPending()) + "\n");
+
+	if (m_bDebugFrameString && m_iSunGrid_Tested)
+		DebugString_Add("Area light grid tested sobs " + itos(m_iSunGrid_Tested) + "\n");
+
+	if (m_bDebugFrameString && m_LightBudget.IsActive())
+		DebugString_Add(m_LightBudget.MakeDebugString());
+
+	if (m_bDebugFrameString && m_bLightLayers)
+		DebugString_Add("Light layers used " + itos(m_LightLayers.m_iNumLayersUsed) + ", shared " + itos(m_LightLayers.m_iNumShared) + "\n");
 #endif
 
 	LPRINT_RUN(2, "TOTAL shadow casters " + itos(m_CasterList_SOBs.size()));
 }
 
+// show the dobs that have come into view and hide those that have left, rather than touching every dob.
+// Dobs out of view but casting shadows into the view are shown on the light layer only.
+void LRoomManager::FrameUpdate_FinalizeVisibility_DOBs()
+{
+	for (int n=0; n<m_VisibleList_DOBs.size(); n++)
+	{
+		LDob &dob = m_DobList.GetDob(m_VisibleList_DOBs[n]);
+		dob.Show(true);
+		dob.SetLayerMask(LRoom::LAYER_MASK_CAMERA | LRoom::LAYER_MASK_LIGHT);
+	}
+
+	for (int n=0; n<m_CasterList_DOBs.size(); n++)
+	{
+		int dob_id = m_CasterList_DOBs[n];
+
+		// lights can be processed during the camera trace, before the dob was found to be visible
+		if (m_BF_visible_DOBs.GetBit(dob_id))
+			continue;
+
+		LDob &dob = m_DobList.GetDob(dob_id);
+		dob.Show(true);
+		dob.SetLayerMask(LRoom::LAYER_MASK_LIGHT);
+	}
+
+	FinalizeVisibility_HideDOBs(m_VisibleList_DOBs_prev);
+	FinalizeVisibility_HideDOBs(m_CasterList_DOBs_prev);
+
+#ifdef LDEBUG_CAMERA
+	if (m_bDebugFrameString)
+		DebugString_Add("Visible DOBs " + itos(m_VisibleList_DOBs.size()) + ", shadow casting DOBs " + itos(m_CasterList_DOBs.size()) + "\n");
+
+	if (m_bDebugFrameString && m_DobList.GetNumAutoUpdate())
+		DebugString_Add("Auto update DOBs moved " + itos(m_iDobsAutoMoved) + " of " + itos(m_DobList.GetNumAutoUpdate()) + "\n");
+#endif
+}
+
+void LRoomManager::FinalizeVisibility_HideDOBs(const LVector<int> &prev_list)
+{
+	for (int n=0; n<prev_list.size(); n++)
+	{
+		int dob_id = prev_list[n];
+
+		// the camera is never hidden
+		if (dob_id == m_DOB_id_camera)
+			continue;
+
+		// may have been unregistered, or registered since the bitfields were created
+		LDob &dob = m_DobList.GetDob(dob_id);
+		if (!dob.m_bSlotTaken || (dob_id >= (int) m_BF_visible_DOBs.GetNumBits()))
+			continue;
+
+		if (!m_BF_visible_DOBs.GetBit(dob_id) && !m_BF_caster_DOBs.GetBit(dob_id))
+			dob.Show(false);
+	}
+}
+
 void LRoomManager::FrameUpdate_FinalizeVisibility_SoftShow()
 {
 	// apply the appropriate soft show for each sob in the render list
@@ -1761,7 +3231,14 @@ void LRoomManager::FrameUpdate_FinalizeVisibility_SoftShow()
 
 			uint32_t flags = 0;
 			if (bVisible) flags |= LRoom::LAYER_MASK_CAMERA;
-			if (bCaster) flags |= LRoom::LAYER_MASK_LIGHT;
+			if (bCaster)
+			{
+				// with light layers, only the lights the sob casts for will draw it
+				if (m_bLightLayers)
+					flags |= m_LightLayers.GetSOBMask(ID);
+				else
+					flags |= LRoom::LAYER_MASK_LIGHT;
+			}
 
 			LRoom::SoftShow(pVI, flags);
 		}
@@ -1802,6 +3279,13 @@ void LRoomManager::FrameUpdate_FinalizeVisibility_SoftShow()
 			}
 		}
 
+		if (m_bLightLayers)
+		{
+			Light * pLight = m_Lights[lid].GetGodotLight();
+			if (pLight)
+				m_LightLayers.UpdateLightMask(lid, pLight);
+		}
+
 		// debug
 		DebugString_Light_AffectedRooms(lid);
 	}
@@ -1950,6 +3434,7 @@ void LRoomManager::FrameUpdate_DrawDebug(const LSource &cam, const LRoom &lroom)
 	}
 
 
+#ifdef DEBUG_ENABLED
 	// if debug bounds are on and there is a bound for this room
 	const Geometry::MeshData &md = lroom.m_Bound_MeshData;
 	if (m_bDebugBounds && md.faces.size())
@@ -1980,7 +3465,7 @@ void LRoomManager::FrameUpdate_DrawDebug(const LSource &cam, const LRoom &lroom)
 
 		im->end();
 	}
-
+#endif
 
 }
 
@@ -2007,6 +3492,9 @@ void LRoomManager::_notification(int p_what) {
 		// For the same reason, the LRoomManager should be low down in the scene tree
 		// so it is updated AFTER the camera.
 	case NOTIFICATION_PROCESS: {
+			if (m_pAsyncConvert)
+				ConvertAsync_Update();
+
 			FrameUpdate();
 		} break;
 	}
@@ -2018,7 +3506,18 @@ void LRoomManager::_bind_methods()
 	// main functions
 	ClassDB::bind_method(D_METHOD("rooms_convert", "verbose", "delete lights"), &LRoomManager::rooms_convert);
 	ClassDB::bind_method(D_METHOD("rooms_single_room_convert", "verbose", "delete lights"), &LRoomManager::rooms_single_room_convert);
+	ClassDB::bind_method(D_METHOD("rooms_convert_async", "verbose", "delete lights"), &LRoomManager::rooms_convert_async);
+	ClassDB::bind_method(D_METHOD("rooms_is_converting"), &LRoomManager::rooms_is_converting);
+	ClassDB::bind_method(D_METHOD("rooms_set_convert_cache", "filename"), &LRoomManager::rooms_set_convert_cache);
 	ClassDB::bind_method(D_METHOD("rooms_set_portal_plane_convention", "flip"), &LRoomManager::rooms_set_portal_plane_convention);
+	ClassDB::bind_method(D_METHOD("rooms_set_portal_max_verts", "max_verts"), &LRoomManager::rooms_set_portal_max_verts);
+	ClassDB::bind_method(D_METHOD("rooms_set_bound_max_planes", "max_planes"), &LRoomManager::rooms_set_bound_max_planes);
+	ClassDB::bind_method(D_METHOD("rooms_set_graph_optimization", "active", "merge_max_objects"), &LRoomManager::rooms_set_graph_optimization);
+
+	ClassDB::bind_method(D_METHOD("rooms_unload_area", "area"), &LRoomManager::rooms_unload_area);
+	ClassDB::bind_method(D_METHOD("rooms_load_area", "area", "area node"), &LRoomManager::rooms_load_area);
+	ClassDB::bind_method(D_METHOD("rooms_is_room_loaded", "room id"), &LRoomManager::rooms_is_room_loaded);
+	ClassDB::bind_method(D_METHOD("rooms_reconvert_room", "room node"), &LRoomManager::rooms_reconvert_room);
 
 	ClassDB::bind_method(D_METHOD("rooms_set_hide_method_detach", "detach"), &LRoomManager::rooms_set_hide_method_detach);
 
@@ -2049,6 +3548,8 @@ void LRoomManager::_bind_methods()
 	ClassDB::bind_method(D_METHOD("dob_register", "node", "pos", "radius"), &LRoomManager::dob_register);
 	ClassDB::bind_method(D_METHOD("dob_unregister", "dob_id"), &LRoomManager::dob_unregister);
 	ClassDB::bind_method(D_METHOD("dob_update", "dob_id", "pos"), &LRoomManager::dob_update);
+	ClassDB::bind_method(D_METHOD("dob_update_batch", "dob_ids", "positions"), &LRoomManager::dob_update_batch);
+	ClassDB::bind_method(D_METHOD("dob_set_auto_update", "dob_id", "auto_update"), &LRoomManager::dob_set_auto_update);
 //	ClassDB::bind_method(D_METHOD("dob_teleport", "dob"), &LRoomManager::dob_teleport);
 
 //	ClassDB::bind_method(D_METHOD("dob_register_hint", "dob", "radius", "room"), &LRoomManager::dob_register_hint);
@@ -2063,12 +3564,20 @@ void LRoomManager::_bind_methods()
 //	ClassDB::bind_method(D_METHOD("dynamic_light_register_hint", "light", "radius", "room"), &LRoomManager::dynamic_light_register_hint);
 	ClassDB::bind_method(D_METHOD("dynamic_light_unregister", "light"), &LRoomManager::dynamic_light_unregister);
 	ClassDB::bind_method(D_METHOD("dynamic_light_update", "light"), &LRoomManager::dynamic_light_update);
+	ClassDB::bind_method(D_METHOD("rooms_set_shadow_receiver_culling", "active"), &LRoomManager::rooms_set_shadow_receiver_culling);
+	ClassDB::bind_method(D_METHOD("rooms_set_static_light_cache_margin", "margin"), &LRoomManager::rooms_set_static_light_cache_margin);
+	ClassDB::bind_method(D_METHOD("rooms_set_light_update_budget", "budget_usec"), &LRoomManager::rooms_set_light_update_budget);
+	ClassDB::bind_method(D_METHOD("rooms_set_light_budget", "max_active", "max_shadowed"), &LRoomManager::rooms_set_light_budget);
+	ClassDB::bind_method(D_METHOD("rooms_set_light_layers", "active"), &LRoomManager::rooms_set_light_layers);
+	ClassDB::bind_method(D_METHOD("rooms_set_directional_split_culling", "active"), &LRoomManager::rooms_set_directional_split_culling);
+	ClassDB::bind_method(D_METHOD("rooms_get_directional_split_casters", "light", "split"), &LRoomManager::rooms_get_directional_split_casters);
 
 	// helper
 	ClassDB::bind_method(D_METHOD("rooms_get_room", "room id"), &LRoomManager::rooms_get_room);
 	ClassDB::bind_method(D_METHOD("rooms_get_num_rooms"), &LRoomManager::rooms_get_num_rooms);
 	ClassDB::bind_method(D_METHOD("rooms_is_room_visible", "room id"), &LRoomManager::rooms_is_room_visible);
 	ClassDB::bind_method(D_METHOD("rooms_get_visible_rooms"), &LRoomManager::rooms_get_visible_rooms);
+	ClassDB::bind_method(D_METHOD("rooms_find_rooms_in_aabb", "aabb"), &LRoomManager::rooms_find_rooms_in_aabb);
 
 
 	ClassDB::bind_method(D_METHOD("set_rooms", "rooms"), &LRoomManager::set_rooms);
@@ -2079,6 +3588,9 @@ void LRoomManager::_bind_methods()
 
 
 	ADD_PROPERTY(PropertyInfo(Variant::NODE_PATH, "rooms"), "set_rooms_path", "get_rooms_path");
+
+	ADD_SIGNAL(MethodInfo("conversion_progress", PropertyInfo(Variant::REAL, "progress")));
+	ADD_SIGNAL(MethodInfo("conversion_finished"));
 }
 
 //////////////////////////////
@@ -2237,32 +3749,8 @@ void LRoomManager::rooms_set_debug_frame_string(bool bActive)
 
 
 
-//void LRoomManager::DobsAutoUpdate()
-//{
-//	// go through each room, each dob
-//	for (int n=0; n<m_Rooms.size(); n++)
-//	{
-//		LRoom &lroom = m_Rooms[n];
-//		int iRoomNum = lroom.m_RoomID;
-
-
-//		for (int d=0; d<lroom.m_DOBs.size(); d++)
-//		{
-//			LDob &dob = lroom.m_DOBs[d];
-//			Spatial * pDOB_Spatial = dob.GetSpatial();
-
-//			if (!pDOB_Spatial)
-//				continue;
-
-//			int iNewRoom = DobUpdate(pDOB_Spatial, &lroom);
+void LRoomManager::DobsAutoUpdate()
+{
+	m_iDobsAutoMoved = m_DobList.AutoUpdate(*this);
+}
 
-//			// changed?
-//			if (iNewRoom != iRoomNum)
-//			{
-//				// very inefficient but will do for testing
-//				DobsAutoUpdate();
-//				return;
-//			}
-//		}
-//	}
-//}
@@ -36,6 +36,15 @@
 #include "larea.h"
 #include "ltrace.h"
 #include "lmain_camera.h"
+#include "lshadow_receivers.h"
+#include "llight_scheduler.h"
+#include "llight_budget.h"
+#include "llight_layers.h"
+#include "lsun_grid.h"
+#include "lroom_grid.h"
+
+class LRoomConverter;
+class LConvertCache;
 
 class LRoomManager : public Spatial {
 	GDCLASS(LRoomManager, Spatial);
@@ -46,6 +55,11 @@ class LRoomManager : public Spatial {
 	friend class LTrace;
 	friend class LMainCamera;
 	friend class LDobList;
+	friend class LLightScheduler;
+	friend class LLightBudget;
+	friend class LSunGrid;
+	friend class LRoomGrid;
+	friend class LConvertCache;
 
 public:
 	// PUBLIC INTERFACE TO GDSCRIPT
@@ -62,6 +76,13 @@ public:
 	// convert empties and meshes to rooms and portals
 	bool rooms_convert(bool bVerbose, bool bDeleteLights);
 	bool rooms_single_room_convert(bool bVerbose, bool bDeleteLights);
+	// convert in the background, e.g. behind a loading screen. Emits conversion_progress (0 to 1)
+	// and conversion_finished, the rooms can't be used until it has finished.
+	bool rooms_convert_async(bool bVerbose, bool bDeleteLights);
+	bool rooms_is_converting() const {return m_pAsyncConvert != 0;}
+	// load the converted level from this file when the scene is unchanged since it was written,
+	// otherwise convert as normal and write the file ("" to disable)
+	void rooms_set_convert_cache(String szFilename);
 	// free memory for current set of rooms, prepare for converting a new game level
 	void rooms_release();
 
@@ -73,8 +94,27 @@ public:
 	// (can be used to find the name etc of a room ID returned by dob_update)
 	Node * rooms_get_room(int room_id);
 
+	// STREAMING
+	// the rooms within an area node can be unloaded and loaded again without reconverting.
+	// Unload before freeing the area node, and load after adding a new instance of it to the scene.
+	bool rooms_unload_area(String szArea);
+	bool rooms_load_area(String szArea, Node * pAreaNode);
+	bool rooms_is_room_loaded(int room_id) const;
+
+	// after editing a room node (or replacing it with a new instance), convert just that room again.
+	// Lights and areas are kept from the full conversion.
+	bool rooms_reconvert_room(Node * pRoomNode);
+
 	// CONVENTIONS
 	void rooms_set_portal_plane_convention(bool bFlip);
+	// portals are simplified on conversion to at most this many verts (0 for no limit, otherwise 4 or more)
+	void rooms_set_portal_max_verts(int max_verts);
+	// room bounds are simplified on conversion to at most this many planes (0 for no limit, otherwise 6 or more)
+	void rooms_set_bound_max_planes(int max_planes);
+	// on conversion, coalesce coplanar portals between the same rooms, and merge neighbouring rooms while they
+	// have at most merge_max_objects objects between them and stay roughly convex (0 to not merge rooms).
+	// Room ids stay those of the room nodes, so merged rooms share their state (visibility etc).
+	void rooms_set_graph_optimization(bool bActive, int merge_max_objects);
 	void rooms_set_hide_method_detach(bool bDetach);
 
 	//______________________________________________________________________________________
@@ -89,6 +129,10 @@ public:
 	bool dob_unregister(int dob_id);
 	// returns the room ID within
 	int dob_update(int dob_id, const Vector3 &pos);
+	// update many dobs in one call, returns the room ID within for each
+	PoolIntArray dob_update_batch(const PoolIntArray &dob_ids, const PoolVector3Array &positions);
+	// track the spatial transform each frame instead of calling dob_update
+	bool dob_set_auto_update(int dob_id, bool bAuto);
 
 	//______________________________________________________________________________________
 	// LIGHTS
@@ -102,6 +146,30 @@ public:
 	bool dynamic_light_unregister(int light_id);
 	int dynamic_light_update(int light_id, const Vector3 &pos, const Vector3 &dir); // returns room within
 
+	// only render shadow casters whose shadows can fall within the rooms the camera can see
+	void rooms_set_shadow_receiver_culling(bool bActive);
+
+	// static lights reuse their shadow casters while the camera moves less than the margin
+	// (0 to disable, and trace every frame)
+	void rooms_set_static_light_cache_margin(float margin);
+
+	// spread the retracing of moving dynamic lights over several frames, with a time budget
+	// in microseconds per frame (0 for unlimited, retracing immediately in dynamic_light_update)
+	void rooms_set_light_update_budget(int budget_usec);
+
+	// limit the number of lights (and lights with shadows) shown each frame, keeping the most important
+	// (0 for unlimited)
+	void rooms_set_light_budget(int max_active, int max_shadowed);
+
+	// give active shadowed lights separate cull mask bits (layers 11 to 18), so each shadow map only
+	// draws the casters for that light. The game should not use these layers for other purposes.
+	void rooms_set_light_layers(bool bActive);
+
+	// find the shadow casters for each split of the directional lights, these can be retrieved
+	// after each frame with rooms_get_directional_split_casters
+	void rooms_set_directional_split_culling(bool bActive);
+	Array rooms_get_directional_split_casters(Node * pLightNode, int split) const;
+
 	//______________________________________________________________________________________
 	// HELPERS
 	// helper function for general use .. LPortal has the functionality, why not...
@@ -110,6 +178,8 @@ public:
 	int rooms_get_num_rooms() const;
 	bool rooms_is_room_visible(int room_id) const;
 	Array rooms_get_visible_rooms() const;
+	// room ids of the rooms whose bounding box overlaps the box
+	Array rooms_find_rooms_in_aabb(const AABB &bb);
 	// helper func, not needed usually as dob_update returns the room
 	int dob_get_room_id(int dob_id);
 	bool export_scene_DAE(Node * pNode, String szFilename);
@@ -165,6 +235,19 @@ private:
 	LVector<int> m_MasterList_SOBs_prev;
 	Lawn::LBitField_Dynamic m_BF_master_SOBs_prev;
 
+	// dobs in view of the camera, found in the camera trace
+	LVector<int> m_VisibleList_DOBs;
+	LVector<int> m_VisibleList_DOBs_prev;
+	Lawn::LBitField_Dynamic m_BF_visible_DOBs;
+
+	// dobs out of view casting shadows into the view, found in the light caster pass
+	LVector<int> m_CasterList_DOBs;
+	LVector<int> m_CasterList_DOBs_prev;
+	Lawn::LBitField_Dynamic m_BF_caster_DOBs;
+
+	// stats for the debug string
+	int m_iDobsAutoMoved;
+
 
 	LVector<int> m_VisibleRoomList_A;
 	LVector<int> m_VisibleRoomList_B;
@@ -189,8 +272,64 @@ private:
 		Lawn::LBitField_Dynamic m_BF_Temp_Visible_Rooms;
 		LVector<int> m_Temp_Visible_SOBs;
 		LVector<int> m_Temp_Visible_Rooms;
+
+		// the casters of a scheduled light that are within the current view
+		LVector<int> m_Temp_InView_SOBs;
 	} m_LightRender;
 
+	// regions of the visible rooms that can receive shadows, used to cull casters
+	LShadowReceivers m_Receivers;
+	bool m_bShadowReceiverCulling;
+
+	// static lights keep their casters for a camera volume expanded by a margin,
+	// which remain valid while the camera frustum stays inside it
+	struct LCasterCache
+	{
+		bool m_bValid;
+		bool m_bInView;
+		LVector<int> m_Casters;
+		LVector<int> m_Rooms;
+		LMainCamera m_Camera;
+	};
+	LVector<LCasterCache> m_CasterCaches;
+	float m_fCasterCacheMargin;
+
+	// stats for the debug string
+	int m_iCasterCache_Hits;
+	int m_iCasterCache_Refreshes;
+
+	LLightScheduler m_LightScheduler;
+
+	// limits the active lights each frame
+	LLightBudget m_LightBudget;
+
+	// give each active light its own caster layer bits, rather than sharing LAYER_MASK_LIGHT
+	LLightLayers m_LightLayers;
+	bool m_bLightLayers;
+
+	// light space grids of the area sobs for each area light (empty for other lights)
+	LVector<LSunGrid> m_SunGrids;
+
+	// spatial index of the rooms for point to room lookups, built at conversion
+	LRoomGrid m_RoomGrid;
+	LVector<int> m_RoomGrid_Temp;
+
+	// stats for the debug string
+	int m_iSunGrid_Tested;
+
+	// godot 3 can't give each directional shadow split its own cull mask, so the casters
+	// for each split are found on request, for the client to make use of
+	enum {MAX_SHADOW_SPLITS = 4};
+	struct LSplitCasters
+	{
+		unsigned int m_uiFrame;
+		int m_iNumSplits;
+		LVector<int> m_Casters[MAX_SHADOW_SPLITS];
+	};
+	LVector<LSplitCasters> m_SplitCasters;
+	LMainCamera m_SplitCamera;
+	bool m_bDirectionalSplits;
+
 
 	// keep a frame counter, to mark when objects have been hit by the visiblity algorithm
 	// already to prevent multiple hits on rooms and objects
@@ -200,12 +339,44 @@ private:
 	// this convention is switchable
 	bool m_bPortalPlane_Convention;
 
+	// portal polygons are reduced to this many verts on conversion (0 is unlimited)
+	int m_iPortalMaxVerts;
+
+	// room bound planes are capped to this on conversion (0 is unlimited)
+	int m_iBoundMaxPlanes;
+
+	// merging rooms and coalescing portals on conversion
+	bool m_bGraphOptimization;
+	int m_iMergeMaxObjects;
+
+	// optional file for caching the converted level
+	String m_szConvertCache;
+
+	// background conversion in progress
+	LRoomConverter * m_pAsyncConvert;
+	LConvertCache * m_pAsyncCache;
+	float m_fAsyncProgress;
+
 private:
 	// lists of rooms and portals, contiguous list so cache friendly
 	LVector<LRoom> m_Rooms;
 	LVector<LPortal> m_Portals;
 	LVector<LArea> m_Areas;
 
+	// The room ids used by the client are those of the room nodes. When rooms are merged on conversion
+	// this maps them to the merged rooms, otherwise it is empty and the ids are the same.
+	struct LUserRoom
+	{
+		int m_iRoom;
+		ObjectID m_GodotID;
+		String m_szName;
+	};
+	LVector<LUserRoom> m_UserRooms;
+
+	// the user rooms of each room, a range in the list for each room
+	LVector<int> m_RoomUsers_First;
+	LVector<int> m_RoomUsers;
+
 	// static objects
 	LVector<LSob> m_SOBs;
 
@@ -296,6 +467,8 @@ private:
 	void FrameUpdate_CreateMasterList();
 	void FrameUpdate_FinalizeVisibility_WithinRooms();
 	void FrameUpdate_FinalizeVisibility_SoftShow();
+	void FinalizeVisibility_HideDOBs(const LVector<int> &prev_list);
+	void FrameUpdate_FinalizeVisibility_DOBs();
 
 	// debugging emulate view frustum
 	void FrameUpdate_FrustumOnly();
@@ -315,11 +488,13 @@ private:
 	//int DobUpdate(Spatial * pDOB_Spatial, LRoom * pRoom);
 	void DobUpdateVisibility(int dob_id);
 
-	// for debugging only have autoupdate mode where all dobs are updated
-//	void DobsAutoUpdate();
+	// poll the auto update dobs for movement
+	void DobsAutoUpdate();
 
 	void CreateDebug();
 	void ReleaseResources(bool bPrepareConvert);
+	void ConvertAsync_Update();
+	void ConvertAsync_Finish();
 	void ShowAll(bool bShow);
 	void ResolveRoomListPath();
 
@@ -329,10 +504,25 @@ private:
 	void DebugString_Light_AffectedRooms(int light_id);
 
 	// now we are centralizing the tracing out from static and dynamic lights for each frame to this function
-	bool LightCreate(Light * pLight, int roomID, String szArea = "");
+	bool LightCreate(Light * pLight, int roomID, String szArea = "", bool bSetCullMask = true);
 	void Light_UpdateTransform(LLight &light, const Light &glight) const;
 	void Light_FrameProcess(int lightID);
 	bool Light_FindCasters(int lightID);
+	void Light_AddCasters(int lightID, const LVector<int> &casters, const LVector<int> &lit_rooms);
+	bool Light_AddCasters_Pending(int lightID);
+	bool Light_AddCasters_InView(int lightID, const LVector<int> &casters, const LVector<int> &lit_rooms);
+	void Light_AddCasterDOBs(int lightID, const LVector<int> &lit_rooms);
+	bool Light_TraceSunGrid(int lightID);
+	void Light_FindSplitCasters(int lightID, const LVector<int> &casters);
+	int Light_GetSplitDistances(int lightID, float * pDistances) const;
+	void Light_RetraceAffectedRooms(int lightID);
+	bool Light_NeedsRetrace(const LLight &light) const;
+	void Light_StoreTraced(LLight &light) const;
+
+	// static light caster cache
+	bool Light_UsesCasterCache(const LLight &light) const;
+	bool Light_UpdateCasterCache(int lightID);
+	void CasterCache_Reset();
 
 
 	// helper funcs
@@ -340,6 +530,15 @@ private:
 	LRoom * GetRoom(int i);
 
 	int FindClosestRoom(const Vector3 &pt) const;
+	int Area_Find(String szName) const;
+	int Room_FindByNode(Node * pRoomNode) const;
+
+	// converting between the room ids used by the client and the merged rooms
+	void UserRooms_Create();
+	int Room_FromUser(int user_id) const;
+	int Room_ToUser(int room_id) const;
+	void Room_AddUsers(int room_id, Array &rooms) const;
+	bool Room_IsMerged(int room_id) const;
 
 	LRoom &Portal_GetLinkedRoom(const LPortal &port);
 
@@ -354,7 +553,8 @@ private:
 
 public:
 	// makes sure m_pRoomList is up to date and valid
-	bool CheckRoomList() {return GetRoomList_Checked() != 0;}
+	// (the rooms can't be used during async conversion)
+	bool CheckRoomList() {return (m_pAsyncConvert == 0) && (GetRoomList_Checked() != 0);}
 
 	Spatial * GetRoomList_Checked();
 	// unchecked, be sure to call checked version first which will set m_pRoomList
@@ -366,6 +566,7 @@ protected:
 
 public:
 	LRoomManager();
+	~LRoomManager();
 };
 
 #endif
@@ -0,0 +1,317 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lshadow_receivers.h"
+#include "lroom.h"
+#include "lportal.h"
+#include "ldob.h"
+#include "lmain_camera.h"
+
+
+LShadowReceivers::LShadowReceivers()
+{
+	m_pLight = 0;
+	m_iNumCulled = 0;
+}
+
+void LShadowReceivers::Prepare(int nRooms, const LMainCamera &cam, const Vector3 &ptCam)
+{
+	// the room lookup is kept all -1 between frames, so only the rooms used need resetting
+	if (m_RoomReceiver.size() != nRooms)
+	{
+		m_RoomReceiver.resize(nRooms);
+		for (int n=0; n<nRooms; n++)
+			m_RoomReceiver[n] = -1;
+	}
+	else
+	{
+		for (int n=0; n<m_ReceiverRooms.size(); n++)
+			m_RoomReceiver[m_ReceiverRooms[n]] = -1;
+	}
+
+	m_Receivers.clear();
+	m_ReceiverRooms.clear();
+	m_LightReceivers.clear();
+	m_pLight = 0;
+	m_iNumCulled = 0;
+
+	m_ptCam = ptCam;
+	m_FarPlane = cam.m_Planes[LMainCamera::P_FAR];
+
+	// the frustum points are the extremes of the view volume
+	m_aabbFrustum.position = cam.m_Points[0];
+	m_aabbFrustum.size = Vector3(0, 0, 0);
+	for (int n=1; n<LMainCamera::NUM_CAM_POINTS; n++)
+		m_aabbFrustum.expand_to(cam.m_Points[n]);
+}
+
+void LShadowReceivers::AddRoomView(const LRoom &room)
+{
+	AddReceiver(room, m_aabbFrustum);
+}
+
+void LShadowReceivers::AddPortalView(const LRoom &room, const LPortal &port)
+{
+	AABB bb = m_aabbFrustum;
+
+	// if the portal pyramid can't be bounded, fall back to the whole frustum
+	AABB bb_pyramid;
+	if (PortalPyramidBound(port, bb_pyramid))
+	{
+		if (!Intersect(m_aabbFrustum, bb_pyramid, bb))
+			return;
+	}
+
+	AddReceiver(room, bb);
+}
+
+void LShadowReceivers::AddReceiver(const LRoom &room, const AABB &bb)
+{
+	// only the part of the view inside the room can receive shadows in the room
+	AABB bb_room;
+	if (!Intersect(room.m_AABB, bb, bb_room))
+		return;
+
+	int id = m_RoomReceiver[room.m_RoomID];
+
+	// the room may be seen through more than one portal
+	if (id != -1)
+	{
+		m_Receivers[id].merge_with(bb_room);
+		return;
+	}
+
+	m_RoomReceiver[room.m_RoomID] = m_Receivers.size();
+	m_Receivers.push_back(bb_room);
+	m_ReceiverRooms.push_back(room.m_RoomID);
+}
+
+// the view beyond a portal is inside the pyramid from the camera through the portal.
+// Clipped by the far plane this is bounded by the portal verts and their projection onto the far plane.
+bool LShadowReceivers::PortalPyramidBound(const LPortal &port, AABB &bb) const
+{
+	int nPoints = port.m_ptsWorld.size();
+	if (!nPoints)
+		return false;
+
+	// should be negative, the camera is inside the frustum
+	float dist_cam = m_FarPlane.distance_to(m_ptCam);
+	if (dist_cam >= 0.0f)
+		return false;
+
+	for (int n=0; n<nPoints; n++)
+	{
+		const Vector3 &pt = port.m_ptsWorld[n];
+		Vector3 ptDir = pt - m_ptCam;
+
+		// portal vert to the side or behind the camera, pyramid is unbounded
+		float denom = m_FarPlane.normal.dot(ptDir);
+		if (denom <= 0.0001f)
+			return false;
+
+		Vector3 ptFar = m_ptCam + (ptDir * (-dist_cam / denom));
+
+		if (n == 0)
+		{
+			bb.position = pt;
+			bb.size = Vector3(0, 0, 0);
+		}
+		else
+			bb.expand_to(pt);
+
+		bb.expand_to(ptFar);
+	}
+
+	return true;
+}
+
+void LShadowReceivers::Light_Begin(const LSource &light, const LVector<int> &lit_rooms)
+{
+	m_pLight = &light;
+	m_LightReceivers.clear();
+
+	// shadows from this light can only fall within rooms the light reached
+	for (int n=0; n<lit_rooms.size(); n++)
+	{
+		int room_id = lit_rooms[n];
+		int id = m_RoomReceiver[room_id];
+		if (id == -1)
+			continue;
+
+		if (!m_LightReceivers.size())
+			m_aabbLightReceivers = m_Receivers[id];
+		else
+			m_aabbLightReceivers.merge_with(m_Receivers[id]);
+
+		m_LightReceivers.push_back(id);
+	}
+}
+
+bool LShadowReceivers::Light_IsCasterRelevant(const AABB &bb) const
+{
+	assert (m_pLight);
+
+	if (!m_LightReceivers.size())
+		return false;
+
+	if (m_pLight->m_eType == LSource::ST_DIRECTIONAL)
+	{
+		for (int n=0; n<m_LightReceivers.size(); n++)
+		{
+			if (SweepHitsReceiver(bb, m_Receivers[m_LightReceivers[n]]))
+				return true;
+		}
+		return false;
+	}
+
+	// omni and spot
+	AABB ext;
+	if (!ExtrudePointLight(bb, ext))
+		return true;
+
+	// quick reject against all the receivers for this light
+	if (!Overlaps(ext, m_aabbLightReceivers))
+		return false;
+
+	for (int n=0; n<m_LightReceivers.size(); n++)
+	{
+		if (Overlaps(ext, m_Receivers[m_LightReceivers[n]]))
+			return true;
+	}
+
+	return false;
+}
+
+// The shadow of a box from a point light, out to the light range, is contained in the hull of the box
+// and the box scaled away from the light by range / closest distance. Returns false if it can't be bounded.
+bool LShadowReceivers::ExtrudePointLight(const AABB &bb, AABB &ext) const
+{
+	const Vector3 &ptLight = m_pLight->m_ptPos;
+	float range = m_pLight->m_fRange;
+
+	// no sensible range, can't cull
+	if (range >= 100000.0f)
+		return false;
+
+	// closest point on the box to the light
+	Vector3 ptMax = bb.position + bb.size;
+	Vector3 ptClosest;
+	ptClosest.x = CLAMP(ptLight.x, bb.position.x, ptMax.x);
+	ptClosest.y = CLAMP(ptLight.y, bb.position.y, ptMax.y);
+	ptClosest.z = CLAMP(ptLight.z, bb.position.z, ptMax.z);
+
+	float dist = ptLight.distance_to(ptClosest);
+
+	// light inside or touching the caster
+	if (dist < 0.001f)
+		return false;
+
+	ext = bb;
+
+	// caster at the edge of the range
+	float scale = range / dist;
+	if (scale <= 1.0f)
+		return true;
+
+	for (int n=0; n<8; n++)
+	{
+		Vector3 pt = bb.get_endpoint(n);
+		ext.expand_to(ptLight + ((pt - ptLight) * scale));
+	}
+
+	return true;
+}
+
+// Sweeping a box along the light direction hits a receiver if the ray from the box centre
+// hits the receiver grown by the box half size
+bool LShadowReceivers::SweepHitsReceiver(const AABB &bb, const AABB &receiver) const
+{
+	Vector3 half = bb.size * 0.5f;
+	Vector3 ptFrom = bb.position + half;
+	Vector3 ptMin = receiver.position - half;
+	Vector3 ptMax = receiver.position + receiver.size + half;
+	const Vector3 &dir = m_pLight->m_ptDir;
+
+	float t_near = 0.0f;
+	float t_far = FLT_MAX;
+
+	for (int a=0; a<3; a++)
+	{
+		if (Math::abs(dir[a]) < 0.00001f)
+		{
+			// parallel to the slab
+			if ((ptFrom[a] < ptMin[a]) || (ptFrom[a] > ptMax[a]))
+				return false;
+			continue;
+		}
+
+		float inv = 1.0f / dir[a];
+		float t0 = (ptMin[a] - ptFrom[a]) * inv;
+		float t1 = (ptMax[a] - ptFrom[a]) * inv;
+		if (t0 > t1)
+			SWAP(t0, t1);
+
+		if (t0 > t_near)
+			t_near = t0;
+		if (t1 < t_far)
+			t_far = t1;
+
+		if (t_near > t_far)
+			return false;
+	}
+
+	return true;
+}
+
+// inclusive of touching, flat boxes are common (floors etc)
+bool LShadowReceivers::Overlaps(const AABB &a, const AABB &b)
+{
+	for (int n=0; n<3; n++)
+	{
+		if (a.position[n] > (b.position[n] + b.size[n]))
+			return false;
+		if (b.position[n] > (a.position[n] + a.size[n]))
+			return false;
+	}
+
+	return true;
+}
+
+bool LShadowReceivers::Intersect(const AABB &a, const AABB &b, AABB &result)
+{
+	if (!Overlaps(a, b))
+		return false;
+
+	Vector3 ptMin;
+	Vector3 ptMax;
+	for (int n=0; n<3; n++)
+	{
+		ptMin[n] = MAX(a.position[n], b.position[n]);
+		ptMax[n] = MIN(a.position[n] + a.size[n], b.position[n] + b.size[n]);
+	}
+
+	result.position = ptMin;
+	result.size = ptMax - ptMin;
+	return true;
+}
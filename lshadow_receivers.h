@@ -0,0 +1,91 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/aabb.h"
+#include "core/math/plane.h"
+
+class LRoom;
+class LPortal;
+class LSource;
+class LMainCamera;
+
+// A shadow is only worth rendering if it can land on something the camera can see.
+// During the camera trace we record a conservative receiver box for each room reached
+// (the room AABB clipped to the view of the room, either the whole frustum or the pyramid through
+// the portal it was seen through). Shadow casters whose light extruded bound misses every receiver
+// lit by the light can be dropped from the caster list.
+class LShadowReceivers
+{
+public:
+	LShadowReceivers();
+
+	// called each frame before the camera trace
+	void Prepare(int nRooms, const LMainCamera &cam, const Vector3 &ptCam);
+
+	// the room containing the camera can be seen through the whole frustum
+	void AddRoomView(const LRoom &room);
+
+	// other rooms can only be seen through the portal they were reached through
+	void AddPortalView(const LRoom &room, const LPortal &port);
+
+	// gather the receivers in the rooms reached by a light trace
+	void Light_Begin(const LSource &light, const LVector<int> &lit_rooms);
+
+	// can the shadow from this caster fall on any receivers of the current light?
+	bool Light_IsCasterRelevant(const AABB &bb) const;
+
+	int GetNumReceivers() const {return m_Receivers.size();}
+
+	// stats for the debug string
+	int m_iNumCulled;
+
+private:
+	void AddReceiver(const LRoom &room, const AABB &bb);
+	bool PortalPyramidBound(const LPortal &port, AABB &bb) const;
+	bool ExtrudePointLight(const AABB &bb, AABB &ext) const;
+	bool SweepHitsReceiver(const AABB &bb, const AABB &receiver) const;
+
+	static bool Overlaps(const AABB &a, const AABB &b);
+	static bool Intersect(const AABB &a, const AABB &b, AABB &result);
+
+	// one receiver per room reached by the camera trace
+	LVector<AABB> m_Receivers;
+	LVector<int> m_ReceiverRooms;
+
+	// receiver index for each room, or -1
+	LVector<int> m_RoomReceiver;
+
+	// receivers for the light currently being processed
+	LVector<int> m_LightReceivers;
+	AABB m_aabbLightReceivers;
+	const LSource * m_pLight;
+
+	// view
+	AABB m_aabbFrustum;
+	Plane m_FarPlane;
+	Vector3 m_ptCam;
+};
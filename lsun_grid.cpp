@@ -0,0 +1,277 @@
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lsun_grid.h"
+#include "lroom_manager.h"
+
+
+LSunGrid::LSunGrid()
+{
+	Clear();
+}
+
+void LSunGrid::Clear()
+{
+	m_bValid = false;
+	m_ptDir = Vector3(0, 0, 0);
+	m_iDimU = 0;
+	m_iDimV = 0;
+	m_uiQuery = 0;
+
+	m_SOBs.clear(true);
+	m_CellStart.clear(true);
+	m_Items.clear(true);
+	m_Tested.clear(true);
+}
+
+bool LSunGrid::IsValidFor(const Vector3 &ptDir) const
+{
+	if (!m_bValid)
+		return false;
+
+	// the shadow volume is expanded by the camera planes anyway, small changes would not matter
+	// but casters could be missed near the edge of the grid
+	return m_ptDir.dot(ptDir) > 0.99999f;
+}
+
+void LSunGrid::Project(const AABB &bb, float &min_u, float &max_u, float &min_v, float &max_v) const
+{
+	for (int n=0; n<8; n++)
+	{
+		Vector3 pt = bb.get_endpoint(n);
+		float u = m_ptU.dot(pt);
+		float v = m_ptV.dot(pt);
+
+		if (n == 0)
+		{
+			min_u = max_u = u;
+			min_v = max_v = v;
+			continue;
+		}
+
+		min_u = MIN(min_u, u);
+		max_u = MAX(max_u, u);
+		min_v = MIN(min_v, v);
+		max_v = MAX(max_v, v);
+	}
+}
+
+void LSunGrid::GetCellRange(float min_u, float max_u, float min_v, float max_v, int &u0, int &u1, int &v0, int &v1) const
+{
+	u0 = CLAMP((int) Math::floor((min_u - m_fMinU) * m_fInvCellU), 0, m_iDimU - 1);
+	u1 = CLAMP((int) Math::floor((max_u - m_fMinU) * m_fInvCellU), 0, m_iDimU - 1);
+	v0 = CLAMP((int) Math::floor((min_v - m_fMinV) * m_fInvCellV), 0, m_iDimV - 1);
+	v1 = CLAMP((int) Math::floor((max_v - m_fMinV) * m_fInvCellV), 0, m_iDimV - 1);
+}
+
+void LSunGrid::Create(const LRoomManager &manager, const LArea &area, const Vector3 &ptDir)
+{
+	Clear();
+
+	m_ptDir = ptDir.normalized();
+
+	// any axes perpendicular to the light will do
+	Vector3 ptUp = (Math::abs(m_ptDir.y) < 0.99f) ? Vector3(0, 1, 0) : Vector3(1, 0, 0);
+	m_ptU = ptUp.cross(m_ptDir).normalized();
+	m_ptV = m_ptDir.cross(m_ptU);
+
+	// gather the sobs in the area
+	int last_room = area.m_iFirstRoom + area.m_iNumRooms;
+	for (int r=area.m_iFirstRoom; r<last_room; r++)
+	{
+		const LRoom &room = manager.m_Rooms[manager.m_AreaRooms[r]];
+
+		int last_sob = room.m_iFirstSOB + room.m_iNumSOBs;
+		for (int n=room.m_iFirstSOB; n<last_sob; n++)
+			m_SOBs.push_back(n);
+	}
+
+	int nSOBs = m_SOBs.size();
+	m_bValid = true;
+
+	if (!nSOBs)
+		return;
+
+	// find the extents in light space
+	float min_u, max_u, min_v, max_v;
+	for (int n=0; n<nSOBs; n++)
+	{
+		float u0, u1, v0, v1;
+		Project(manager.m_SOBs[m_SOBs[n]].m_aabb, u0, u1, v0, v1);
+
+		if (n == 0)
+		{
+			min_u = u0; max_u = u1;
+			min_v = v0; max_v = v1;
+			continue;
+		}
+
+		min_u = MIN(min_u, u0);
+		max_u = MAX(max_u, u1);
+		min_v = MIN(min_v, v0);
+		max_v = MAX(max_v, v1);
+	}
+
+	// roughly one sob per cell
+	int dim = CLAMP((int) Math::ceil(Math::sqrt((float) nSOBs)), 1, 64);
+	m_iDimU = dim;
+	m_iDimV = dim;
+
+	m_fMinU = min_u;
+	m_fMinV = min_v;
+	m_fInvCellU = dim / MAX(max_u - min_u, 0.001f);
+	m_fInvCellV = dim / MAX(max_v - min_v, 0.001f);
+
+	int nCells = m_iDimU * m_iDimV;
+
+	// count the items in each cell, then place them
+	m_CellStart.resize(nCells + 1);
+	for (int n=0; n<=nCells; n++)
+		m_CellStart[n] = 0;
+
+	LVector<int> fill;
+
+	for (int pass=0; pass<2; pass++)
+	{
+		for (int n=0; n<nSOBs; n++)
+		{
+			float fu0, fu1, fv0, fv1;
+			Project(manager.m_SOBs[m_SOBs[n]].m_aabb, fu0, fu1, fv0, fv1);
+
+			int u0, u1, v0, v1;
+			GetCellRange(fu0, fu1, fv0, fv1, u0, u1, v0, v1);
+
+			for (int v=v0; v<=v1; v++)
+			{
+				for (int u=u0; u<=u1; u++)
+				{
+					int cell = (v * m_iDimU) + u;
+
+					if (pass == 0)
+						m_CellStart[cell + 1]++;
+					else
+						m_Items[fill[cell]++] = n;
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (int c=0; c<nCells; c++)
+				m_CellStart[c + 1] += m_CellStart[c];
+
+			m_Items.resize(m_CellStart[nCells]);
+
+			// fill position of each cell while placing
+			fill.resize(nCells);
+			for (int c=0; c<nCells; c++)
+				fill[c] = m_CellStart[c];
+		}
+	}
+
+	m_Tested.resize(nSOBs);
+	for (int n=0; n<nSOBs; n++)
+		m_Tested[n] = 0;
+}
+
+int LSunGrid::FindCasters(const LRoomManager &manager, const LMainCamera &cam, const LVector<Plane> &planes, Lawn::LBitField_Dynamic &BF_SOBs, LVector<int> &casters)
+{
+	if (!m_SOBs.size())
+		return 0;
+
+	// the camera light volume is the view frustum extruded towards the light,
+	// in light space this is covered by the frustum points
+	float min_u, max_u, min_v, max_v;
+	for (int n=0; n<cam.m_Points.size(); n++)
+	{
+		const Vector3 &pt = cam.m_Points[n];
+		float u = m_ptU.dot(pt);
+		float v = m_ptV.dot(pt);
+
+		if (n == 0)
+		{
+			min_u = max_u = u;
+			min_v = max_v = v;
+			continue;
+		}
+
+		min_u = MIN(min_u, u);
+		max_u = MAX(max_u, u);
+		min_v = MIN(min_v, v);
+		max_v = MAX(max_v, v);
+	}
+
+	m_uiQuery++;
+
+	int u0, u1, v0, v1;
+	GetCellRange(min_u, max_u, min_v, max_v, u0, u1, v0, v1);
+
+	int nTested = 0;
+
+	for (int v=v0; v<=v1; v++)
+	{
+		for (int u=u0; u<=u1; u++)
+		{
+			int cell = (v * m_iDimU) + u;
+			int last_item = m_CellStart[cell + 1];
+
+			for (int i=m_CellStart[cell]; i<last_item; i++)
+			{
+				int local_id = m_Items[i];
+				if (m_Tested[local_id] == m_uiQuery)
+					continue;
+				m_Tested[local_id] = m_uiQuery;
+
+				int sob_id = m_SOBs[local_id];
+				if (BF_SOBs.GetBit(sob_id))
+					continue;
+
+				nTested++;
+
+				const AABB &bb = manager.m_SOBs[sob_id].m_aabb;
+
+				bool bShow = true;
+				for (int p=0; p<planes.size(); p++)
+				{
+					float r_min, r_max;
+					bb.project_range_in_plane(planes[p], r_min, r_max);
+
+					if (r_min > 0.0f)
+					{
+						bShow = false;
+						break;
+					}
+				}
+
+				if (bShow)
+				{
+					BF_SOBs.SetBit(sob_id, true);
+					casters.push_back(sob_id);
+				}
+			}
+		}
+	}
+
+	return nTested;
+}
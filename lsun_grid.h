@@ -0,0 +1,80 @@
+#pragma once
+
+//	Copyright (c) 2019 Lawnjelly
+
+//	Permission is hereby granted, free of charge, to any person obtaining a copy
+//	of this software and associated documentation files (the "Software"), to deal
+//	in the Software without restriction, including without limitation the rights
+//	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//	copies of the Software, and to permit persons to whom the Software is
+//	furnished to do so, subject to the following conditions:
+
+//	The above copyright notice and this permission notice shall be included in all
+//	copies or substantial portions of the Software.
+
+//	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//	SOFTWARE.
+
+/**
+	@author lawnjelly <lawnjelly@gmail.com>
+*/
+
+#include "lvector.h"
+#include "core/math/plane.h"
+
+class LRoomManager;
+class LArea;
+class LMainCamera;
+namespace Lawn {class LBitField_Dynamic;}
+
+// Area (global directional) lights would otherwise test every SOB in every room of the area each frame.
+// Instead the area SOBs are sorted into a 2D grid in light space (looking down the light direction),
+// and only the cells under the view need testing against the camera light planes.
+// The grid is only rebuilt if the light direction changes.
+class LSunGrid
+{
+public:
+	LSunGrid();
+	void Clear();
+
+	// is the grid usable for the current light direction
+	bool IsValidFor(const Vector3 &ptDir) const;
+	void Create(const LRoomManager &manager, const LArea &area, const Vector3 &ptDir);
+
+	// adds the casters within the planes to the list, returns the number of sobs tested
+	int FindCasters(const LRoomManager &manager, const LMainCamera &cam, const LVector<Plane> &planes, Lawn::LBitField_Dynamic &BF_SOBs, LVector<int> &casters);
+
+private:
+	void Project(const AABB &bb, float &min_u, float &max_u, float &min_v, float &max_v) const;
+	void GetCellRange(float min_u, float max_u, float min_v, float max_v, int &u0, int &u1, int &v0, int &v1) const;
+
+	bool m_bValid;
+
+	// light space
+	Vector3 m_ptDir;
+	Vector3 m_ptU;
+	Vector3 m_ptV;
+
+	float m_fMinU;
+	float m_fMinV;
+	float m_fInvCellU;
+	float m_fInvCellV;
+	int m_iDimU;
+	int m_iDimV;
+
+	// sob ids in the grid, the cells refer to these by local index
+	LVector<int> m_SOBs;
+
+	// items for each cell are contiguous, cell n from m_CellStart[n] to m_CellStart[n+1]
+	LVector<int> m_CellStart;
+	LVector<int> m_Items;
+
+	// sobs can be in more than one cell, only test them once per query
+	LVector<unsigned int> m_Tested;
+	unsigned int m_uiQuery;
+};
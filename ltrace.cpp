@@ -36,7 +36,7 @@ void LTrace::Trace_Prepare(LRoomManager &manager, const LSource &cam, Lawn::LBit
 	m_pCamera = &cam;
 
 	// default
-	m_TraceFlags = CULL_SOBS | CULL_DOBS | TOUCH_ROOMS | MAKE_ROOM_VISIBLE;
+	m_TraceFlags = CULL_SOBS | CULL_DOBS | TOUCH_ROOMS | MAKE_ROOM_VISIBLE | FIND_RECEIVERS;
 
 	m_pBF_SOBs = &BF_SOBs;
 //	m_pBF_DOBs = &BF_DOBs;
@@ -44,6 +44,8 @@ void LTrace::Trace_Prepare(LRoomManager &manager, const LSource &cam, Lawn::LBit
 	m_pVisible_SOBs = &visible_SOBs;
 //	m_pVisible_DOBs = &visible_DOBs;
 	m_pVisible_Rooms = &visible_Rooms;
+
+	m_pPool = &manager.m_Pool;
 }
 
 void LTrace::CullSOBs(LRoom &room, const LVector<Plane> &planes)
@@ -104,7 +106,44 @@ void LTrace::CullSOBs(LRoom &room, const LVector<Plane> &planes)
 
 void LTrace::CullDOBs(LRoom &room, const LVector<Plane> &planes)
 {
-	// NYI this isn't efficient, there may be more than 1 portal to the same room
+	// dobs are only culled for the camera, dobs casting shadows are found in LRoomManager::Light_AddCasterDOBs
+	if (m_pCamera->m_eType != LSource::ST_CAMERA)
+		return;
+
+	const LDobList &dobs = LMAN->m_DobList;
+
+	for (int dob_id = room.m_iFirstDOB; dob_id != -1; dob_id = dobs.GetDob(dob_id).m_iNextInRoom)
+	{
+		// already visible through another portal
+		if (LMAN->m_BF_visible_DOBs.GetBit(dob_id))
+			continue;
+
+		// the camera is never culled
+		if (dob_id == LMAN->m_DOB_id_camera)
+			continue;
+
+		const LDob &dob = dobs.GetDob(dob_id);
+
+		bool bShow = true;
+		for (int p=0; p<planes.size(); p++)
+		{
+			float dist = planes[p].distance_to(dob.m_ptPos);
+
+			if (dist > dob.m_fRadius)
+			{
+				bShow = false;
+				break;
+			}
+		}
+
+		if (bShow)
+		{
+			LMAN->m_BF_visible_DOBs.SetBit(dob_id, true);
+			LMAN->m_VisibleList_DOBs.push_back(dob_id);
+		}
+	}
+
+	// old version
 /*
 	// cull DOBs
 	int nDOBs = room.m_DOBs.size();
@@ -150,6 +189,12 @@ void LTrace::CullDOBs(LRoom &room, const LVector<Plane> &planes)
 
 
 bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun eRun)
+{
+	LRoomManager::LLightRender &lr = manager.m_LightRender;
+	return Trace_Light(manager, light, eRun, manager.m_Pool, lr.m_BF_Temp_SOBs, lr.m_BF_Temp_Visible_Rooms, lr.m_Temp_Visible_SOBs, lr.m_Temp_Visible_Rooms);
+}
+
+bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun eRun, LPlanesPool &pool, Lawn::LBitField_Dynamic &BF_SOBs, Lawn::LBitField_Dynamic &BF_Rooms, LVector<int> &visible_SOBs, LVector<int> &visible_Rooms)
 {
 	m_pManager = &manager;
 
@@ -178,19 +223,18 @@ bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun e
 
 	const LSource &cam = light.m_Source;
 
-	unsigned int pool_member = manager.m_Pool.Request();
+	unsigned int pool_member = pool.Request();
 	assert (pool_member != (unsigned int) -1);
 
-	LVector<Plane> &planes = manager.m_Pool.Get(pool_member);
+	LVector<Plane> &planes = pool.Get(pool_member);
 	planes.clear();
 
 	// we now need to trace either just DOBs (in the case of static lights)
 	// or SOBs and DOBs (in the case of dynamic lights)
-	LRoomManager::LLightRender &lr = manager.m_LightRender;
-	lr.m_BF_Temp_SOBs.Blank();
-	lr.m_Temp_Visible_SOBs.clear();
-	lr.m_BF_Temp_Visible_Rooms.Blank();
-	lr.m_Temp_Visible_Rooms.clear();
+	BF_SOBs.Blank();
+	visible_SOBs.clear();
+	BF_Rooms.Blank();
+	visible_Rooms.clear();
 
 	bool bLightInView = true;
 
@@ -200,7 +244,7 @@ bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun e
 	case LR_ALL:
 		{
 			//Trace_Prepare(manager, cam, lr.m_BF_Temp_SOBs, manager.m_BF_visible_rooms, lr.m_Temp_Visible_SOBs, *manager.m_pCurr_VisibleRoomList);
-			Trace_Prepare(manager, cam, lr.m_BF_Temp_SOBs, lr.m_BF_Temp_Visible_Rooms, lr.m_Temp_Visible_SOBs, lr.m_Temp_Visible_Rooms);
+			Trace_Prepare(manager, cam, BF_SOBs, BF_Rooms, visible_SOBs, visible_Rooms);
 
 			Trace_SetFlags(CULL_SOBS | CULL_DOBS | MAKE_ROOM_VISIBLE);
 
@@ -208,10 +252,17 @@ bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun e
 			bLightInView = manager.m_MainCamera.AddCameraLightPlanes(manager, cam, planes);
 		}
 		break;
+	// finding casters to keep for later frames, so not clipped by the camera
+	case LR_CASTERS:
+		{
+			Trace_Prepare(manager, cam, BF_SOBs, BF_Rooms, visible_SOBs, visible_Rooms);
+			Trace_SetFlags(CULL_SOBS | MAKE_ROOM_VISIBLE);
+		}
+		break;
 	// finding only visible rooms at runtime
 	case LR_ROOMS:
 		{
-			Trace_Prepare(manager, cam, lr.m_BF_Temp_SOBs, lr.m_BF_Temp_Visible_Rooms, lr.m_Temp_Visible_SOBs, lr.m_Temp_Visible_Rooms);
+			Trace_Prepare(manager, cam, BF_SOBs, BF_Rooms, visible_SOBs, visible_Rooms);
 
 			// we ONLY want a list of rooms hit
 			Trace_SetFlags(MAKE_ROOM_VISIBLE);
@@ -220,7 +271,7 @@ bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun e
 	// finding all in preconversion
 	case LR_CONVERT:
 		{
-			Trace_Prepare(manager, cam, lr.m_BF_Temp_SOBs, lr.m_BF_Temp_Visible_Rooms, lr.m_Temp_Visible_SOBs, lr.m_Temp_Visible_Rooms);
+			Trace_Prepare(manager, cam, BF_SOBs, BF_Rooms, visible_SOBs, visible_Rooms);
 
 			// we want sobs but not to touch rooms
 			m_TraceFlags = CULL_SOBS | MAKE_ROOM_VISIBLE; //  | CULL_DOBS | TOUCH_ROOMS;
@@ -280,7 +331,7 @@ bool LTrace::Trace_Light(LRoomManager &manager, const LLight &light, eLightRun e
 	} // if light in view
 
 	// we no longer need these planes
-	manager.m_Pool.Free(pool_member);
+	pool.Free(pool_member);
 
 	return bLightInView;
 }
@@ -385,6 +436,9 @@ void LTrace::Trace_Begin(LRoom &room, LVector<Plane> &planes)
 	LPRINT_RUN(2, "TRACE BEGIN");
 	LPRINT_RUN(2, m_pCamera->MakeDebugString());
 
+	// the start room is seen through the whole frustum
+	if (m_TraceFlags & FIND_RECEIVERS)
+		LMAN->m_Receivers.AddRoomView(room);
 
 	Trace_Recursive(0, room, planes, first_plane);
 }
@@ -400,7 +454,8 @@ void LTrace::Trace_Recursive(int depth, LRoom &room, const LVector<Plane> &plane
 	}
 
 	// for debugging
-	Lawn::LDebug::m_iTabDepth = depth;
+	if (m_bTabDepth)
+		Lawn::LDebug::m_iTabDepth = depth;
 	LPRINT_RUN(2, "");
 
 	LPRINT_RUN(2, "ROOM '" + itos(room.m_RoomID) + " : " + room.get_name() + "' planes " + itos(planes.size()) + " portals " + itos(room.m_iNumPortals) );
@@ -434,6 +489,9 @@ void LTrace::Trace_Recursive(int depth, LRoom &room, const LVector<Plane> &plane
 		// get the room pointed to by the portal
 		LRoom * pLinkedRoom = &LMAN->Portal_GetLinkedRoom(port);
 
+		// portals into unloaded areas are closed
+		if (!pLinkedRoom->m_bLoaded)
+			continue;
 
 
 		// cull by portal angle to camera.
@@ -475,7 +533,7 @@ void LTrace::Trace_Recursive(int depth, LRoom &room, const LVector<Plane> &plane
 
 		// while clipping to the planes we maintain a list of partial planes, so we can add them to the
 		// recursive next iteration of planes to check
-		static LVector<int> partial_planes;
+		LVector<int> &partial_planes = m_PartialPlanes;
 		partial_planes.clear();
 
 		// for portals, we want to ignore the near clipping plane, as we might be right on the edge of a doorway
@@ -514,11 +572,11 @@ void LTrace::Trace_Recursive(int depth, LRoom &room, const LVector<Plane> &plane
 		}
 
 		// else recurse into that portal
-		unsigned int uiPoolMem = LMAN->m_Pool.Request();
+		unsigned int uiPoolMem = m_pPool->Request();
 		if (uiPoolMem != (unsigned int) -1)
 		{
 			// get a vector of planes from the pool
-			LVector<Plane> &new_planes = LMAN->m_Pool.Get(uiPoolMem);
+			LVector<Plane> &new_planes = m_pPool->Get(uiPoolMem);
 			new_planes.clear();
 
 			// NEW!! if portal is totally inside the planes, don't copy the old planes
@@ -540,14 +598,18 @@ void LTrace::Trace_Recursive(int depth, LRoom &room, const LVector<Plane> &plane
 
 			if (pLinkedRoom)
 			{
+				if (m_TraceFlags & FIND_RECEIVERS)
+					LMAN->m_Receivers.AddPortalView(*pLinkedRoom, port);
+
 				Trace_Recursive(depth+1, *pLinkedRoom, new_planes, 0);
 				//pLinkedRoom->DetermineVisibility_Recursive(manager, depth + 1, cam, new_planes, 0);
 				// for debugging need to reset tab depth
-				Lawn::LDebug::m_iTabDepth = depth;
+				if (m_bTabDepth)
+					Lawn::LDebug::m_iTabDepth = depth;
 			}
 
 			// we no longer need these planes
-			LMAN->m_Pool.Free(uiPoolMem);
+			m_pPool->Free(uiPoolMem);
 		}
 		else
 		{
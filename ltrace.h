@@ -26,6 +26,7 @@ class LSource;
 class LRoomManager;
 class LRoom;
 class LLight;
+class LPlanesPool;
 namespace Lawn {class LBitField_Dynamic;}
 
 class LTrace
@@ -38,11 +39,13 @@ public:
 		TOUCH_ROOMS = 1 << 2,
 		MAKE_ROOM_VISIBLE = 1 << 3,
 		DONT_TRACE_PORTALS = 1 << 4,
+		FIND_RECEIVERS = 1 << 5,
 	};
 
 	enum eLightRun
 	{
 		LR_ALL, // runtime find all shadow casters
+		LR_CASTERS, // runtime find all shadow casters the light reaches, whatever the camera can see
 		LR_ROOMS, // find affected rooms
 		LR_CONVERT, // initial conversion
 	};
@@ -50,12 +53,21 @@ public:
 	void Trace_Prepare(LRoomManager &manager, const LSource &cam, Lawn::LBitField_Dynamic &BF_SOBs, Lawn::LBitField_Dynamic &BF_Rooms, LVector<int> &visible_SOBs, LVector<int> &visible_Rooms);
 //	void Trace_Prepare(LRoomManager &manager, const LCamera &cam, Lawn::LBitField_Dynamic &BF_SOBs, Lawn::LBitField_Dynamic &BF_DOBs, Lawn::LBitField_Dynamic &BF_Rooms, LVector<int> &visible_SOBs, LVector<int> &visible_DOBs, LVector<int> &visible_Rooms);
 
+	LTrace() {m_bTabDepth = true;}
+
+	// the debug tab depth is shared, so traces running on worker threads must leave it alone
+	void Trace_SetTabDepth(bool bSet) {m_bTabDepth = bSet;}
+
 	void Trace_SetFlags(unsigned int flags) {m_TraceFlags = flags;}
+	unsigned int Trace_GetFlags() const {return m_TraceFlags;}
 	void Trace_Begin(LRoom &room, LVector<Plane> &planes);
 
 	// simpler method of doing a trace for lights, no need to call prepare and begin
 	bool Trace_Light(LRoomManager &manager, const LLight &light, eLightRun eRun);
 
+	// as above but with the caller's own buffers, so light traces can run on several threads during conversion
+	bool Trace_Light(LRoomManager &manager, const LLight &light, eLightRun eRun, LPlanesPool &pool, Lawn::LBitField_Dynamic &BF_SOBs, Lawn::LBitField_Dynamic &BF_Rooms, LVector<int> &visible_SOBs, LVector<int> &visible_Rooms);
+
 private:
 	void AddSpotlightPlanes(LVector<Plane> &planes) const;
 	void Trace_Recursive(int depth, LRoom &room, const LVector<Plane> &planes, int first_portal_plane);
@@ -77,5 +89,11 @@ private:
 	//LVector<int> * m_pVisible_DOBs;
 	LVector<int> * m_pVisible_Rooms;
 
+	LPlanesPool * m_pPool;
+
+	// the planes a portal partially clips, reused for each portal
+	LVector<int> m_PartialPlanes;
+
 	unsigned int m_TraceFlags;
+	bool m_bTabDepth;
 };